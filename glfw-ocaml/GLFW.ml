@@ -147,6 +147,27 @@ type key_mod =
   | Alt
   | Super
 
+module KeyModSet =
+  struct
+    type t = int
+
+    let all = [Shift; Control; Alt; Super]
+
+    let bit = function
+      | Shift -> 1
+      | Control -> 2
+      | Alt -> 4
+      | Super -> 8
+
+    let empty = 0
+    let is_empty t = t = 0
+    let mem m t = t land bit m <> 0
+    let add m t = t lor bit m
+    let remove m t = t land lnot (bit m)
+    let of_list l = List.fold_left (fun t m -> add m t) empty l
+    let to_list t = List.filter (fun m -> mem m t) all
+  end
+
 let mouse_button_max_count = 8
 
 let mouse_button_left = 0
@@ -296,12 +317,52 @@ type video_mode = {
     refresh_rate : int
   }
 
+type video_mode_priority =
+  | ResolutionFirst
+  | RefreshRateFirst
+
 type monitor [@@immediate]
 
+type monitor_info = {
+    monitor : monitor;
+    name : string;
+    xpos : int;
+    ypos : int;
+    workarea_xpos : int;
+    workarea_ypos : int;
+    workarea_width : int;
+    workarea_height : int;
+    width_mm : int;
+    height_mm : int;
+    xscale : float;
+    yscale : float;
+    video_mode : video_mode;
+    video_modes : video_mode array
+  }
+
 type window [@@immediate]
 
 type cursor [@@immediate]
 
+type cursor_animation [@@immediate]
+
+type vk_instance [@@immediate]
+
+type vk_physical_device [@@immediate]
+
+type proc_table [@@immediate]
+
+type frame_limiter [@@immediate]
+
+type osmesa_depth_buffer =
+  | Depth16 of
+      (int, Bigarray.int16_unsigned_elt, Bigarray.c_layout) Bigarray.Array2.t
+  | Depth32 of (int32, Bigarray.int32_elt, Bigarray.c_layout) Bigarray.Array2.t
+
+type capture_output =
+  | CaptureRaw of string
+  | CaptureY4M of string * int
+
 module GammaRamp =
   struct
     open Bigarray
@@ -332,6 +393,61 @@ module Image =
       else if width * height * 4 > Bytes.length pixels
       then invalid_arg "Image.create: insufficient pixel data."
       else { width; height; pixels }
+
+    type pixel_format =
+      | RGBA
+      | BGRA
+      | PremultipliedRGBA
+      | PremultipliedBGRA
+      | RGB
+      | BGR
+
+    external convert_pixels : pixel_format -> bytes -> bytes -> int -> unit
+      = "caml_convertImagePixels" [@@noalloc]
+    external scale_pixels : t -> bytes -> int -> int -> unit
+      = "caml_scaleImagePixels" [@@noalloc]
+
+    let bytes_per_pixel = function
+      | RGB | BGR -> 3
+      | RGBA | BGRA | PremultipliedRGBA | PremultipliedBGRA -> 4
+
+    let convert ~format ~width ~height ~pixels =
+      if width < 0 || height < 0
+      then invalid_arg "Image.convert: negative dimension."
+      else if width * height * bytes_per_pixel format > Bytes.length pixels
+      then invalid_arg "Image.convert: insufficient pixel data."
+      else
+        let dst = Bytes.create (width * height * 4) in
+        convert_pixels format pixels dst (width * height);
+        { width; height; pixels = dst }
+
+    let scale ~image ~width ~height =
+      if width <= 0 || height <= 0
+      then invalid_arg "Image.scale: non-positive dimension."
+      else if image.width = 0 || image.height = 0
+      then invalid_arg "Image.scale: empty image."
+      else
+        let pixels = Bytes.create (width * height * 4) in
+        scale_pixels image pixels width height;
+        { width; height; pixels }
+
+    let icon_set ~image ~sizes =
+      List.map (fun size -> scale ~image ~width:size ~height:size) sizes
+  end
+
+module BigarrayImage =
+  struct
+    open Bigarray
+
+    type pixels = (int, int8_unsigned_elt, c_layout) Array1.t
+    type t = { width : int; height : int; pixels : pixels }
+
+    let create ~width ~height ~pixels =
+      if width < 0 || height < 0
+      then invalid_arg "BigarrayImage.create: negative dimension."
+      else if width * height * 4 > Array1.dim pixels
+      then invalid_arg "BigarrayImage.create: insufficient pixel data."
+      else { width; height; pixels }
   end
 
 type hat_status =
@@ -340,11 +456,89 @@ type hat_status =
   | HatDown
   | HatLeft
 
+module HatStatusSet =
+  struct
+    type t = int
+
+    let all = [HatUp; HatRight; HatDown; HatLeft]
+
+    let bit = function
+      | HatUp -> 1
+      | HatRight -> 2
+      | HatDown -> 4
+      | HatLeft -> 8
+
+    let empty = 0
+    let is_empty t = t = 0
+    let mem h t = t land bit h <> 0
+    let add h t = t lor bit h
+    let remove h t = t land lnot (bit h)
+    let of_list l = List.fold_left (fun t h -> add h t) empty l
+    let to_list t = List.filter (fun h -> mem h t) all
+  end
+
 type gamepad_state = {
     buttons : bool array;
     axes : float array;
   }
 
+type event =
+  | WindowPos of window * int * int
+  | WindowSize of window * int * int
+  | WindowClose of window
+  | WindowRefresh of window
+  | WindowFocus of window * bool
+  | WindowIconify of window * bool
+  | WindowMaximize of window * bool
+  | FramebufferSize of window * int * int
+  | WindowContentScale of window * float * float
+  | Key of window * key * int * key_action * key_mod list
+  | Char of window * int
+  | MouseButton of window * int * bool * key_mod list
+  | CursorPos of window * float * float
+  | CursorEnter of window * bool
+  | Scroll of window * float * float
+
+type coalescable_event =
+  | WindowPosEvents
+  | WindowSizeEvents
+  | FramebufferSizeEvents
+  | CursorPosEvents
+  | ScrollEvents
+
+type coalescing_policy =
+  | NoCoalescing
+  | LatestWins
+  | Accumulate
+
+module InputState =
+  struct
+    type t = Bytes.t
+
+    let key_bitmap_size = 32
+    let buttons_offset = 3 * key_bitmap_size
+
+    external key_index : key -> int = "%identity"
+
+    let create () = Bytes.make (buttons_offset + 3) '\000'
+
+    let test t offset index =
+      Char.code (Bytes.unsafe_get t (offset + index lsr 3))
+      land (1 lsl (index land 7)) <> 0
+
+    let test_button t offset button =
+      button >= 0 && button < 8
+      && Char.code (Bytes.unsafe_get t (buttons_offset + offset))
+         land (1 lsl button) <> 0
+
+    let isKeyDown t key = test t 0 (key_index key)
+    let wasKeyPressed t key = test t key_bitmap_size (key_index key)
+    let wasKeyReleased t key = test t (2 * key_bitmap_size) (key_index key)
+    let isMouseButtonDown t button = test_button t 0 button
+    let wasMouseButtonPressed t button = test_button t 1 button
+    let wasMouseButtonReleased t button = test_button t 2 button
+  end
+
 external init : unit -> unit = "caml_glfwInit"
 external terminate : unit -> unit = "caml_glfwTerminate"
 external initHint : hint:'a init_hint -> value:'a -> unit = "caml_glfwInitHint"
@@ -360,6 +554,12 @@ external getMonitorPhysicalSize : monitor:monitor -> int * int
 external getMonitorContentScale : monitor:monitor -> float * float
   = "caml_glfwGetMonitorContentScale"
 external getMonitorName : monitor:monitor -> string = "caml_glfwGetMonitorName"
+external getMonitorTopology : unit -> monitor_info array
+  = "caml_getMonitorTopology"
+external getMonitorGeneration : unit -> int
+  = "caml_getMonitorGeneration" [@@noalloc]
+external invalidateMonitorTopology : unit -> unit
+  = "caml_invalidateMonitorTopology" [@@noalloc]
 external setMonitorCallback :
   f:(monitor -> connection_event -> unit) option
   -> (monitor -> connection_event -> unit) option
@@ -367,10 +567,26 @@ external setMonitorCallback :
 external getVideoModes : monitor:monitor -> video_mode list
   = "caml_glfwGetVideoModes"
 external getVideoMode : monitor:monitor -> video_mode = "caml_glfwGetVideoMode"
+external getVideoModesBigarray :
+  monitor:monitor
+  -> (int32, Bigarray.int32_elt, Bigarray.c_layout) Bigarray.Array2.t
+  = "caml_getVideoModesBigarray"
+external findVideoMode :
+  monitor:monitor -> width:int -> height:int -> refreshRate:int option
+  -> priority:video_mode_priority -> video_mode option
+  = "caml_findVideoMode"
 external setGamma : monitor:monitor -> gamma:float -> unit = "caml_glfwSetGamma"
 external getGammaRamp : monitor:monitor -> GammaRamp.t = "caml_glfwGetGammaRamp"
 external setGammaRamp : monitor:monitor -> gamma_ramp:GammaRamp.t -> unit
   = "caml_glfwSetGammaRamp"
+external getGammaRampInto : monitor:monitor -> gamma_ramp:GammaRamp.t -> unit
+  = "caml_getGammaRampInto"
+external startGammaTransition :
+  monitor:monitor -> start:GammaRamp.t -> target:GammaRamp.t -> duration:float
+  -> unit
+  = "caml_startGammaTransition"
+external cancelGammaTransition : monitor:monitor -> unit
+  = "caml_cancelGammaTransition"
 external defaultWindowHints : unit -> unit = "caml_glfwDefaultWindowHints"
 external windowHint : hint:('a, [`hint]) window_attr -> value:'a -> unit
   = "caml_glfwWindowHint"
@@ -378,6 +594,15 @@ external createWindow :
   width:int -> height:int -> title:string -> ?monitor:monitor -> ?share:window
   -> unit -> window
   = "caml_glfwCreateWindow_byte" "caml_glfwCreateWindow"
+external createOffscreenWindow :
+  width:int -> height:int -> ?share:window -> unit -> window
+  = "caml_createOffscreenWindow"
+external getOSMesaColorBuffer :
+  window:window ->
+  (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array3.t
+  = "caml_glfwGetOSMesaColorBuffer"
+external getOSMesaDepthBuffer : window:window -> osmesa_depth_buffer
+  = "caml_glfwGetOSMesaDepthBuffer"
 external destroyWindow : window:window -> unit = "caml_glfwDestroyWindow"
 external windowShouldClose : window:window -> bool
   = "caml_glfwWindowShouldClose"
@@ -387,6 +612,9 @@ external setWindowTitle : window:window -> title:string -> unit
   = "caml_glfwSetWindowTitle"
 external setWindowIcon : window:window -> images:Image.t list -> unit
   = "caml_glfwSetWindowIcon"
+external setWindowIconBigarray :
+  window:window -> images:BigarrayImage.t list -> unit
+  = "caml_setWindowIconBigarray"
 external getWindowPos : window:window -> int * int = "caml_glfwGetWindowPos"
 external setWindowPos : window:window -> xpos:int -> ypos:int -> unit
   = "caml_glfwSetWindowPos"
@@ -467,6 +695,15 @@ external waitEvents : unit -> unit = "caml_glfwWaitEvents"
 external waitEventsTimeout : timeout:float -> unit
   = "caml_glfwWaitEventsTimeout"
 external postEmptyEvent : unit -> unit = "caml_glfwPostEmptyEvent"
+external getEventFd : unit -> Unix.file_descr option = "caml_getEventFd"
+external waitUntil : deadline:(float [@unboxed]) -> bool
+  = "caml_waitUntil" "caml_waitUntil_unboxed"
+external createFrameLimiter : period:float -> frame_limiter
+  = "caml_createFrameLimiter"
+external destroyFrameLimiter : limiter:frame_limiter -> unit
+  = "caml_destroyFrameLimiter"
+external limitFrame : limiter:frame_limiter -> (float [@unboxed])
+  = "caml_limitFrame" "caml_limitFrame_unboxed"
 external getInputMode : window:window -> mode:'a input_mode -> 'a
   = "caml_glfwGetInputMode"
 external setInputMode : window:window -> mode:'a input_mode -> value:'a -> unit
@@ -484,16 +721,32 @@ external setCursorPos : window:window -> xpos:float -> ypos:float -> unit
   = "caml_glfwSetCursorPos"
 external createCursor : image:Image.t -> xhot:int -> yhot:int -> cursor
   = "caml_glfwCreateCursor"
+external createCursorBigarray :
+  image:BigarrayImage.t -> xhot:int -> yhot:int -> cursor
+  = "caml_createCursorBigarray"
 external createStandardCursor : shape:cursor_shape -> cursor
   = "caml_glfwCreateStandardCursor"
 external destroyCursor : cursor:cursor -> unit = "caml_glfwDestroyCursor"
 external setCursor : window:window -> cursor:cursor -> unit
   = "caml_glfwSetCursor"
+external createCursorAnimation :
+  frames:(Image.t * float) array -> xhot:int -> yhot:int -> cursor_animation
+  = "caml_createCursorAnimation"
+external destroyCursorAnimation : animation:cursor_animation -> unit
+  = "caml_destroyCursorAnimation"
+external setCursorAnimation :
+  window:window -> animation:cursor_animation option -> unit
+  = "caml_setCursorAnimation"
 external setKeyCallback :
   window:window
   -> f:(window -> key -> int -> key_action -> key_mod list -> unit) option
   -> (window -> key -> int -> key_action -> key_mod list -> unit) option
   = "caml_glfwSetKeyCallback"
+external setKeyCallbackBitset :
+  window:window
+  -> f:(window -> key -> int -> key_action -> KeyModSet.t -> unit) option
+  -> (window -> key -> int -> key_action -> KeyModSet.t -> unit) option
+  = "caml_glfwSetKeyCallbackBitset"
 external setCharCallback :
   window:window -> f:(window -> int -> unit) option
   -> (window -> int -> unit) option
@@ -502,10 +755,18 @@ external setCharModsCallback :
   window:window -> f:(window -> int -> key_mod list -> unit) option
   -> (window -> int -> key_mod list -> unit) option
   = "caml_glfwSetCharModsCallback" [@@deprecated]
+external setCharModsCallbackBitset :
+  window:window -> f:(window -> int -> KeyModSet.t -> unit) option
+  -> (window -> int -> KeyModSet.t -> unit) option
+  = "caml_glfwSetCharModsCallbackBitset" [@@deprecated]
 external setMouseButtonCallback :
   window:window -> f:(window -> int -> bool -> key_mod list -> unit) option
   -> (window -> int -> bool -> key_mod list -> unit) option
   = "caml_glfwSetMouseButtonCallback"
+external setMouseButtonCallbackBitset :
+  window:window -> f:(window -> int -> bool -> KeyModSet.t -> unit) option
+  -> (window -> int -> bool -> KeyModSet.t -> unit) option
+  = "caml_glfwSetMouseButtonCallbackBitset"
 external setCursorPosCallback :
   window:window -> f:(window -> float -> float -> unit) option
   -> (window -> float -> float -> unit) option
@@ -522,12 +783,32 @@ external setDropCallback :
   window:window -> f:(window -> string list -> unit) option
   -> (window -> string list -> unit) option
   = "caml_glfwSetDropCallback"
+external setEventQueueing : window:window -> enabled:bool -> unit
+  = "caml_setEventQueueing"
+external getEventQueueing : window:window -> bool = "caml_getEventQueueing"
+external drainEvents : unit -> event array = "caml_drainEvents"
+external pollEventsBatch : unit -> event array = "caml_pollEventsBatch"
+external setEventCoalescing :
+  window:window -> event:coalescable_event -> policy:coalescing_policy -> unit
+  = "caml_setEventCoalescing"
+external getEventCoalescing :
+  window:window -> event:coalescable_event -> coalescing_policy
+  = "caml_getEventCoalescing"
+external setInputTracking : window:window -> enabled:bool -> unit
+  = "caml_setInputTracking"
+external getInputTracking : window:window -> bool = "caml_getInputTracking"
+external getInputSnapshot : window:window -> state:InputState.t -> unit
+  = "caml_getInputSnapshot_noalloc" [@@noalloc]
+external setFrameStatsCollection : window:window -> enabled:bool -> unit
+  = "caml_setFrameStatsCollection"
 external joystickPresent : joy:int -> bool = "caml_glfwJoystickPresent"
 external getJoystickAxes : joy:int -> float array = "caml_glfwGetJoystickAxes"
 external getJoystickButtons : joy:int -> bool array
   = "caml_glfwGetJoystickButtons"
 external getJoystickHats : joy:int -> hat_status list array
   = "caml_glfwGetJoystickHats"
+external getJoystickHatsBitset : joy:int -> HatStatusSet.t array
+  = "caml_glfwGetJoystickHatsBitset"
 external getJoystickName : joy:int -> string option = "caml_glfwGetJoystickName"
 external getJoystickGUID : joy:int -> string option = "caml_glfwGetJoystickGUID"
 external joystickIsGamepad : joy:int -> bool = "caml_glfwJoystickIsGamepad"
@@ -542,10 +823,32 @@ external getGamepadState : joy:int -> gamepad_state = "caml_glfwGetGamepadState"
 external setClipboardString : window:_ -> string:string -> unit
   = "caml_glfwSetClipboardString"
 external getClipboardString : window:_ -> string = "caml_glfwGetClipboardString"
-external getTime : unit -> float = "caml_glfwGetTime"
-external setTime : time:float -> unit = "caml_glfwSetTime"
-external getTimerValue : unit -> int64 = "caml_glfwGetTimerValue"
-external getTimerFrequency : unit -> int64 = "caml_glfwGetTimerFrequency"
+external getClipboardBigarray :
+  buffer:(char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+  -> int
+  = "caml_getClipboardBigarray"
+external getClipboardBigarrayIfChanged :
+  buffer:(char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+  -> int
+  = "caml_getClipboardBigarrayIfChanged"
+external set_clipboard_bigarray :
+  (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+  -> int -> unit
+  = "caml_setClipboardBigarray"
+
+let setClipboardBigarray ~data ~length =
+  if length < 0 || length > Bigarray.Array1.dim data
+  then invalid_arg "setClipboardBigarray: invalid length."
+  else set_clipboard_bigarray data length
+
+external getTime : unit -> (float [@unboxed])
+  = "caml_glfwGetTime" "caml_glfwGetTime_unboxed"
+external setTime : time:(float [@unboxed]) -> unit
+  = "caml_glfwSetTime" "caml_glfwSetTime_unboxed"
+external getTimerValue : unit -> (int64 [@unboxed])
+  = "caml_glfwGetTimerValue" "caml_glfwGetTimerValue_unboxed"
+external getTimerFrequency : unit -> (int64 [@unboxed])
+  = "caml_glfwGetTimerFrequency" "caml_glfwGetTimerFrequency_unboxed"
 external makeContextCurrent : window:window option -> unit
   = "caml_glfwMakeContextCurrent"
 external getCurrentContext : unit -> window option
@@ -554,6 +857,210 @@ external swapBuffers : window:window -> unit = "caml_glfwSwapBuffers"
 external swapInterval : interval:int -> unit = "caml_glfwSwapInterval"
 external extensionSupported : extension:string -> bool
   = "caml_glfwExtensionSupported"
+external getProcAddress : procname:string -> nativeint option
+  = "caml_glfwGetProcAddress"
+external createProcTable : names:string array -> proc_table
+  = "caml_createProcTable"
+external destroyProcTable : table:proc_table -> unit = "caml_destroyProcTable"
+external getProcTableEntry : table:proc_table -> index:int -> nativeint
+  = "caml_getProcTableEntry"
+external getProcTableAddress : table:proc_table -> nativeint
+  = "caml_getProcTableAddress"
+external presentPixels :
+  window:window -> image:BigarrayImage.t ->
+  damage:(int * int * int * int) array option -> unit
+  = "caml_presentPixels"
+external startCapture :
+  window:window -> buffers:int -> output:capture_output option -> unit
+  = "caml_startCapture"
+external stopCapture : window:window -> unit = "caml_stopCapture"
+external getCapturedFrame :
+  window:window ->
+  (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array3.t option
+  = "caml_getCapturedFrame"
+external getCaptureDroppedFrames : window:window -> int
+  = "caml_getCaptureDroppedFrames"
+external vulkanSupported : unit -> bool = "caml_glfwVulkanSupported"
+external getRequiredInstanceExtensions : unit -> string array
+  = "caml_glfwGetRequiredInstanceExtensions"
+external getInstanceProcAddress :
+  instance:vk_instance option -> procname:string -> nativeint option
+  = "caml_glfwGetInstanceProcAddress"
+external getPhysicalDevicePresentationSupport :
+  instance:vk_instance -> device:vk_physical_device -> queuefamily:int -> bool
+  = "caml_glfwGetPhysicalDevicePresentationSupport"
+external createWindowSurface : instance:vk_instance -> window:window -> int64
+  = "caml_glfwCreateWindowSurface"
+external vkInstanceOfNativeint : nativeint -> vk_instance
+  = "caml_vkInstanceOfNativeint"
+external nativeintOfVkInstance : vk_instance -> nativeint
+  = "caml_nativeintOfVkInstance"
+external vkPhysicalDeviceOfNativeint : nativeint -> vk_physical_device
+  = "caml_vkPhysicalDeviceOfNativeint"
+external nativeintOfVkPhysicalDevice : vk_physical_device -> nativeint
+  = "caml_nativeintOfVkPhysicalDevice"
+
+module Noalloc =
+  struct
+    open Bigarray
+
+    external getTime : unit -> (float [@unboxed])
+      = "caml_glfwGetTime_noalloc_byte" "caml_glfwGetTime_noalloc"
+      [@@noalloc]
+    external getTimerNanoseconds : unit -> (int [@untagged])
+      = "caml_getTimerNanoseconds_noalloc_byte"
+        "caml_getTimerNanoseconds_noalloc"
+      [@@noalloc]
+    external windowShouldClose : window:window -> bool
+      = "caml_glfwWindowShouldClose_noalloc" [@@noalloc]
+    external getKey : window:window -> key:key -> bool
+      = "caml_glfwGetKey_noalloc" [@@noalloc]
+    external getMouseButton : window:window -> button:int -> bool
+      = "caml_glfwGetMouseButton_noalloc" [@@noalloc]
+
+    external get_cursor_pos_into :
+      window -> (float, float64_elt, c_layout) Array1.t -> unit
+      = "caml_glfwGetCursorPosInto_noalloc" [@@noalloc]
+    external get_window_size_into : window -> int array -> unit
+      = "caml_glfwGetWindowSizeInto_noalloc" [@@noalloc]
+    external get_framebuffer_size_into : window -> int array -> unit
+      = "caml_glfwGetFramebufferSizeInto_noalloc" [@@noalloc]
+    external get_frame_stats_into :
+      window -> (float, float64_elt, c_layout) Array1.t -> unit
+      = "caml_getFrameStatsInto_noalloc" [@@noalloc]
+
+    let getCursorPosInto ~window ~pos =
+      if Array1.dim pos < 2
+      then invalid_arg "Noalloc.getCursorPosInto: buffer too small."
+      else get_cursor_pos_into window pos
+
+    let getWindowSizeInto ~window ~size =
+      if Array.length size < 2
+      then invalid_arg "Noalloc.getWindowSizeInto: array too small."
+      else get_window_size_into window size
+
+    let getFramebufferSizeInto ~window ~size =
+      if Array.length size < 2
+      then invalid_arg "Noalloc.getFramebufferSizeInto: array too small."
+      else get_framebuffer_size_into window size
+
+    let getFrameStatsInto ~window ~stats =
+      if Array1.dim stats < 12
+      then invalid_arg "Noalloc.getFrameStatsInto: buffer too small."
+      else get_frame_stats_into window stats
+  end
+
+module Unchecked =
+  struct
+    type error =
+      | NotInitialized
+      | NoCurrentContext
+      | InvalidEnum
+      | InvalidValue
+      | OutOfMemory
+      | ApiUnavailable
+      | VersionUnavailable
+      | PlatformError
+      | FormatUnavailable
+      | NoWindowContext
+
+    external getErrorDescription : unit -> string
+      = "caml_getErrorDescription"
+
+    external joystickPresent : joy:int -> (bool, error) result
+      = "caml_glfwJoystickPresent_unchecked"
+    external getJoystickAxes : joy:int -> (float array, error) result
+      = "caml_glfwGetJoystickAxes_unchecked"
+    external getJoystickButtons : joy:int -> (bool array, error) result
+      = "caml_glfwGetJoystickButtons_unchecked"
+    external getJoystickHats : joy:int -> (hat_status list array, error) result
+      = "caml_glfwGetJoystickHats_unchecked"
+    external getJoystickHatsBitset :
+      joy:int -> (HatStatusSet.t array, error) result
+      = "caml_glfwGetJoystickHatsBitset_unchecked"
+    external getJoystickName : joy:int -> (string option, error) result
+      = "caml_glfwGetJoystickName_unchecked"
+    external getJoystickGUID : joy:int -> (string option, error) result
+      = "caml_glfwGetJoystickGUID_unchecked"
+    external joystickIsGamepad : joy:int -> (bool, error) result
+      = "caml_glfwJoystickIsGamepad_unchecked"
+    external getGamepadName : joy:int -> (string option, error) result
+      = "caml_glfwGetGamepadName_unchecked"
+    external getGamepadState : joy:int -> (gamepad_state, error) result
+      = "caml_glfwGetGamepadState_unchecked"
+    external getKey : window:window -> key:key -> (bool, error) result
+      = "caml_glfwGetKey_unchecked"
+    external getMouseButton :
+      window:window -> button:int -> (bool, error) result
+      = "caml_glfwGetMouseButton_unchecked"
+    external getCursorPos : window:window -> (float * float, error) result
+      = "caml_glfwGetCursorPos_unchecked"
+    external getWindowPos : window:window -> (int * int, error) result
+      = "caml_glfwGetWindowPos_unchecked"
+    external getWindowSize : window:window -> (int * int, error) result
+      = "caml_glfwGetWindowSize_unchecked"
+    external getFramebufferSize : window:window -> (int * int, error) result
+      = "caml_glfwGetFramebufferSize_unchecked"
+    external getWindowFrameSize :
+      window:window -> (int * int * int * int, error) result
+      = "caml_glfwGetWindowFrameSize_unchecked"
+    external getWindowContentScale :
+      window:window -> (float * float, error) result
+      = "caml_glfwGetWindowContentScale_unchecked"
+  end
+
+module Profile =
+  struct
+    open Bigarray
+
+    external set_profiling : bool -> unit = "caml_setProfiling" [@@noalloc]
+    external isEnabled : unit -> bool = "caml_isProfiling" [@@noalloc]
+    external reset : unit -> unit = "caml_resetProfile" [@@noalloc]
+    external getStats :
+      unit -> string array * (float, float64_elt, c_layout) Array2.t
+      = "caml_getProfile"
+
+    let histogramBuckets = 32
+
+    let enable () = set_profiling true
+    let disable () = set_profiling false
+
+    (* Upper bound in microseconds of the histogram bucket holding the given
+       percentile of the calls of row i. *)
+    let percentile stats i p =
+      let calls = stats.{i, 0} in
+      let rec find b seen =
+        let seen = seen +. stats.{i, 3 + b} in
+        if b = histogramBuckets - 1 || seen >= p *. calls
+        then ldexp 1.0 (b + 1) /. 1000.0
+        else find (b + 1) seen in
+      find 0 0.0
+
+    let report () =
+      let names, stats = getStats () in
+      let rows = Array.init (Array.length names) (fun i -> i) in
+      let buffer = Buffer.create 4096 in
+      Array.sort (fun i j -> compare stats.{j, 1} stats.{i, 1}) rows;
+      Printf.bprintf buffer "%-40s %10s %12s %10s %10s %10s %12s\n"
+        "stub" "calls" "total (ms)" "mean (us)" "p50 (us)" "p99 (us)"
+        "words/call";
+      Array.iter (fun i ->
+          let calls = stats.{i, 0} and total = stats.{i, 1} in
+          Printf.bprintf buffer
+            "%-40s %10.0f %12.3f %10.3f %10.3f %10.3f %12.1f\n"
+            names.(i) calls (total *. 1e3) (total *. 1e6 /. calls)
+            (percentile stats i 0.5) (percentile stats i 0.99)
+            (stats.{i, 2} /. calls))
+        rows;
+      Buffer.contents buffer
+  end
+
+module Trace =
+  struct
+    external start : capacity:int -> unit = "caml_startTrace"
+    external stop : unit -> unit = "caml_stopTrace" [@@noalloc]
+    external write : path:string -> unit = "caml_writeTrace"
+  end
 
 external init_stub : unit -> unit = "init_stub" [@@noalloc]
 
@@ -568,4 +1075,14 @@ let () =
   Callback.register_exception "GLFW.PlatformError" (PlatformError "");
   Callback.register_exception "GLFW.FormatUnavailable" (FormatUnavailable "");
   Callback.register_exception "GLFW.NoWindowContext" (NoWindowContext "");
-  init_stub ()
+  init_stub ();
+  if Profile.isEnabled ()
+  then at_exit (fun () -> prerr_string (Profile.report ()));
+  match Sys.getenv "GLFW_OCAML_TRACE" with
+  | "" -> ()
+  | path ->
+     begin match Trace.start ~capacity:262144 with
+     | () -> at_exit (fun () -> Trace.stop (); Trace.write ~path)
+     | exception ApiUnavailable message -> prerr_endline message
+     end
+  | exception Not_found -> ()
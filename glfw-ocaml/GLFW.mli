@@ -165,6 +165,21 @@ type key_mod =
   | Alt
   | Super
 
+(** Sets of keyboard key and mouse button modifiers represented as immediate
+    integers, as passed to the callbacks set with the *Bitset functions. *)
+module KeyModSet :
+  sig
+    type t = private int
+
+    val empty : t
+    val is_empty : t -> bool
+    val mem : key_mod -> t -> bool
+    val add : key_mod -> t -> t
+    val remove : key_mod -> t -> t
+    val of_list : key_mod list -> t
+    val to_list : t -> key_mod list
+  end
+
 (** Maximum number of buttons handled for a mouse. *)
 val mouse_button_max_count : int
 
@@ -363,12 +378,66 @@ type video_mode = {
     refresh_rate : int;
   }
 
+(** Criterion compared first by findVideoMode. *)
+type video_mode_priority =
+  | ResolutionFirst
+  | RefreshRateFirst
+
 type monitor [@@immediate]
 
+(** Monitor properties as returned by getMonitorTopology, gathering the
+    results of getMonitorPos, getMonitorWorkarea, getMonitorPhysicalSize,
+    getMonitorContentScale, getMonitorName, getVideoMode and getVideoModes. *)
+type monitor_info = {
+    monitor : monitor;
+    name : string;
+    xpos : int;
+    ypos : int;
+    workarea_xpos : int;
+    workarea_ypos : int;
+    workarea_width : int;
+    workarea_height : int;
+    width_mm : int;
+    height_mm : int;
+    xscale : float;
+    yscale : float;
+    video_mode : video_mode;
+    video_modes : video_mode array;
+  }
+
 type window [@@immediate]
 
 type cursor [@@immediate]
 
+type cursor_animation [@@immediate]
+
+(** Vulkan dispatchable handles, as created by a separate Vulkan binding.
+    See vkInstanceOfNativeint and vkPhysicalDeviceOfNativeint. *)
+type vk_instance [@@immediate]
+
+type vk_physical_device [@@immediate]
+
+(** A table of GL function pointers, see createProcTable. *)
+type proc_table [@@immediate]
+
+(** A frame pacing state, see createFrameLimiter. *)
+type frame_limiter [@@immediate]
+
+(** Depth buffer of an OSMesa context as returned by getOSMesaDepthBuffer,
+    with values of 16 or 32 bits depending on the DepthBits hint. *)
+type osmesa_depth_buffer =
+  | Depth16 of
+      (int, Bigarray.int16_unsigned_elt, Bigarray.c_layout) Bigarray.Array2.t
+  | Depth32 of (int32, Bigarray.int32_elt, Bigarray.c_layout) Bigarray.Array2.t
+
+(** File a capture is streamed to. CaptureRaw writes the RGBA pixels of each
+    frame from top to bottom with no header. CaptureY4M writes a YUV4MPEG2
+    stream in the 4:4:4 color space with the given number of frames per
+    second. *)
+type capture_output =
+  | CaptureRaw of string
+  | CaptureY4M of string * int
+
 (** GammaRamp module. Describes the gamma ramp for a monitor.
 
     @see <http://www.glfw.org/docs/latest/structGLFWgammaramp.html> *)
@@ -401,6 +470,52 @@ module Image :
         @raise Invalid_argument if a dimension is negative or if there is not
         enough data to make an image with the specified dimensions. *)
     val create : width:int -> height:int -> pixels:bytes -> t
+
+    (** Pixel formats which can be converted to the non-premultiplied RGBA
+        format used by GLFW. All use 8 bits per channel. *)
+    type pixel_format =
+      | RGBA
+      | BGRA
+      | PremultipliedRGBA
+      | PremultipliedBGRA
+      | RGB
+      | BGR
+
+    (** Create an image from pixel data in the given format. The conversion is
+        done in C, using SIMD instructions where available.
+
+        @raise Invalid_argument if a dimension is negative or if there is not
+        enough data to make an image with the specified dimensions. *)
+    val convert :
+      format:pixel_format -> width:int -> height:int -> pixels:bytes -> t
+
+    (** Create a copy of an image resized to the given dimensions with a box
+        filter. Colors are weighted by alpha.
+
+        @raise Invalid_argument if a dimension is not positive or if the image
+        is empty. *)
+    val scale : image:t -> width:int -> height:int -> t
+
+    (** Create square copies of an image of each of the given sizes, for use
+        with setWindowIcon. *)
+    val icon_set : image:t -> sizes:int list -> t list
+  end
+
+(** Image data stored in a Bigarray, so that pixels decoded or mapped by C
+    libraries can be passed to createCursorBigarray and setWindowIconBigarray
+    without being copied. *)
+module BigarrayImage :
+  sig
+    type pixels =
+      (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+    type t = private { width : int; height : int; pixels : pixels }
+
+    (** Create an image from the supplied pixel data with the specified width
+        and height.
+
+        @raise Invalid_argument if a dimension is negative or if there is not
+        enough data to make an image with the specified dimensions. *)
+    val create : width:int -> height:int -> pixels:pixels -> t
   end
 
 (** Hat statuses as returned by getJoystickHats.
@@ -412,6 +527,21 @@ type hat_status =
   | HatDown
   | HatLeft
 
+(** Sets of hat statuses represented as immediate integers, as returned by
+    getJoystickHatsBitset. The empty set means the hat is centered. *)
+module HatStatusSet :
+  sig
+    type t = private int
+
+    val empty : t
+    val is_empty : t -> bool
+    val mem : hat_status -> t -> bool
+    val add : hat_status -> t -> t
+    val remove : hat_status -> t -> t
+    val of_list : hat_status list -> t
+    val to_list : t -> hat_status list
+  end
+
 (** Gamepad state data as returned by getGamepadState.
 
     @see <http://www.glfw.org/docs/latest/structGLFWgamepadstate.html> *)
@@ -420,6 +550,58 @@ type gamepad_state = {
     axes : float array;
   }
 
+(** Window events as returned by drainEvents and pollEventsBatch. Each
+    constructor carries the same arguments as the corresponding callback. *)
+type event =
+  | WindowPos of window * int * int
+  | WindowSize of window * int * int
+  | WindowClose of window
+  | WindowRefresh of window
+  | WindowFocus of window * bool
+  | WindowIconify of window * bool
+  | WindowMaximize of window * bool
+  | FramebufferSize of window * int * int
+  | WindowContentScale of window * float * float
+  | Key of window * key * int * key_action * key_mod list
+  | Char of window * int
+  | MouseButton of window * int * bool * key_mod list
+  | CursorPos of window * float * float
+  | CursorEnter of window * bool
+  | Scroll of window * float * float
+
+(** Events which can be coalesced with setEventCoalescing. *)
+type coalescable_event =
+  | WindowPosEvents
+  | WindowSizeEvents
+  | FramebufferSizeEvents
+  | CursorPosEvents
+  | ScrollEvents
+
+(** Coalescing policies. With LatestWins only the last event received is
+    delivered, with Accumulate a single event carrying the sum of the offsets
+    of all the events received is delivered. *)
+type coalescing_policy =
+  | NoCoalescing
+  | LatestWins
+  | Accumulate
+
+(** Keyboard key and mouse button states of a window, as filled by
+    getInputSnapshot. The pressed and released sets only hold the transitions
+    which occurred during the last call to pollEvents, pollEventsBatch,
+    waitEvents or waitEventsTimeout. Queries do not cross into C code. *)
+module InputState :
+  sig
+    type t
+
+    val create : unit -> t
+    val isKeyDown : t -> key -> bool
+    val wasKeyPressed : t -> key -> bool
+    val wasKeyReleased : t -> key -> bool
+    val isMouseButtonDown : t -> int -> bool
+    val wasMouseButtonPressed : t -> int -> bool
+    val wasMouseButtonReleased : t -> int -> bool
+  end
+
 (** Module functions. These are mostly identical to their original GLFW
     counterparts.
 
@@ -428,6 +610,17 @@ type gamepad_state = {
     If you need to make user data accessible inside a callback you can instead
     capture it in a closure and use that closure as your callback function.
 
+    The *Bitset variants of the key, character with modifiers and mouse button
+    callback setters and of getJoystickHats pass modifiers and hat statuses as
+    immediate integer sets instead of lists, so that no allocation is needed.
+    A window can have both variants of a callback set at the same time, in
+    which case the Bitset one is called first.
+
+    waitEvents, waitEventsTimeout and swapBuffers release the OCaml runtime
+    while they block, so that other threads (from the threads library) can run
+    in the meantime. Callbacks fired during these calls take the runtime back
+    before running as usual.
+
     There is no binding for the glfwWindowHintString function. Simply pass your
     string to the windowHint function as you would for any other value type.
 
@@ -435,13 +628,15 @@ type gamepad_state = {
     deprecated and is no longer used. You may pass the unit value (or anything)
     as the window argument.
 
-    There is no binding for the glfwGetProcAddress function because it would
-    basicaly require to write an entire OpenGL wrapper to make the functions
-    returned by GLFW usable from OCaml. There are numerous OpenGL bindings
-    available for OCaml that you can use instead.
+    The getProcAddress function returns the address of a GL function as a
+    nativeint, which is only usable from C code or another binding. Stubs
+    calling GL functions often should rather resolve them once through a
+    proc_table.
 
-    The Vulkan related functions are not supported as of now but we might look
-    into it at some point.
+    Vulkan handles are not typed in GLFW-OCaml beyond what GLFW requires: the
+    instance and physical device are converted from the raw pointers exposed
+    by your Vulkan binding and the created surface is returned as an int64.
+    Custom allocators are not supported by createWindowSurface.
 
     @see <http://www.glfw.org/docs/latest/glfw3_8h.html#func-members> *)
 
@@ -460,6 +655,23 @@ external getMonitorPhysicalSize : monitor:monitor -> int * int
 external getMonitorContentScale : monitor:monitor -> float * float
   = "caml_glfwGetMonitorContentScale"
 external getMonitorName : monitor:monitor -> string = "caml_glfwGetMonitorName"
+
+(** Monitor topology cache. getMonitorTopology returns the properties of all
+    connected monitors, the primary one first. The array is only rebuilt
+    after a monitor was connected or disconnected, or the library was
+    (re)initialized, in which case getMonitorGeneration also changes value;
+    otherwise the same array is returned at no cost. It must not be mutated.
+
+    GLFW does not report changes of work area or content scale: call
+    invalidateMonitorTopology to force a rebuild when these may have
+    changed. *)
+external getMonitorTopology : unit -> monitor_info array
+  = "caml_getMonitorTopology"
+external getMonitorGeneration : unit -> int
+  = "caml_getMonitorGeneration" [@@noalloc]
+external invalidateMonitorTopology : unit -> unit
+  = "caml_invalidateMonitorTopology" [@@noalloc]
+
 external setMonitorCallback :
   f:(monitor -> connection_event -> unit) option
   -> (monitor -> connection_event -> unit) option
@@ -467,10 +679,51 @@ external setMonitorCallback :
 external getVideoModes : monitor:monitor -> video_mode list
   = "caml_glfwGetVideoModes"
 external getVideoMode : monitor:monitor -> video_mode = "caml_glfwGetVideoMode"
+
+(** getVideoModesBigarray returns the video modes of a monitor as a single
+    Bigarray with one row per mode, holding in order the width, height, red,
+    green and blue bits and refresh rate of the mode.
+
+    findVideoMode returns the video mode of a monitor closest to the given
+    resolution and refresh rate (any rate if None), comparing first the
+    criterion given by priority. Remaining ties are broken by preferring modes
+    with more color bits, then higher refresh rates. *)
+external getVideoModesBigarray :
+  monitor:monitor
+  -> (int32, Bigarray.int32_elt, Bigarray.c_layout) Bigarray.Array2.t
+  = "caml_getVideoModesBigarray"
+external findVideoMode :
+  monitor:monitor -> width:int -> height:int -> refreshRate:int option
+  -> priority:video_mode_priority -> video_mode option
+  = "caml_findVideoMode"
+
 external setGamma : monitor:monitor -> gamma:float -> unit = "caml_glfwSetGamma"
 external getGammaRamp : monitor:monitor -> GammaRamp.t = "caml_glfwGetGammaRamp"
 external setGammaRamp : monitor:monitor -> gamma_ramp:GammaRamp.t -> unit
   = "caml_glfwSetGammaRamp"
+
+(** getGammaRampInto stores the current gamma ramp of a monitor into the
+    channels of an existing gamma ramp.
+
+    startGammaTransition sets the gamma ramp of a monitor to start, then
+    interpolates it towards target over duration seconds. The ramp is updated
+    on the C side each time events are processed by pollEvents,
+    pollEventsBatch, waitEvents or waitEventsTimeout. Starting a transition
+    cancels the previous one on the same monitor, as does disconnecting the
+    monitor. The ramps are copied and may be reused right away.
+
+    @raise Invalid_argument if the gamma ramp passed to getGammaRampInto is
+    not of the size of the monitor's, or if start and target are of
+    different sizes. *)
+external getGammaRampInto : monitor:monitor -> gamma_ramp:GammaRamp.t -> unit
+  = "caml_getGammaRampInto"
+external startGammaTransition :
+  monitor:monitor -> start:GammaRamp.t -> target:GammaRamp.t -> duration:float
+  -> unit
+  = "caml_startGammaTransition"
+external cancelGammaTransition : monitor:monitor -> unit
+  = "caml_cancelGammaTransition"
+
 external defaultWindowHints : unit -> unit = "caml_glfwDefaultWindowHints"
 external windowHint : hint:('a, [`hint]) window_attr -> value:'a -> unit
   = "caml_glfwWindowHint"
@@ -478,6 +731,30 @@ external createWindow :
   width:int -> height:int -> title:string -> ?monitor:monitor -> ?share:window
   -> unit -> window
   = "caml_glfwCreateWindow_byte" "caml_glfwCreateWindow"
+
+(** Offscreen rendering. createOffscreenWindow creates a window that is never
+    shown, with an empty title, leaving the Visible hint as it was before the
+    call. Combined with the ContextCreationApi hint set to OSMesaContextApi,
+    rendering is done in software and needs no GPU.
+
+    getOSMesaColorBuffer and getOSMesaDepthBuffer return the buffers of an
+    OSMesa context without copying them, with dimensions height, width and
+    for the color buffer bytes per pixel. Rows are stored bottom to top. The
+    Bigarrays alias memory owned by the context and must not be used once
+    the window has been resized or destroyed.
+
+    @raise NoWindowContext if the context of the window is not an OSMesa
+    context. *)
+external createOffscreenWindow :
+  width:int -> height:int -> ?share:window -> unit -> window
+  = "caml_createOffscreenWindow"
+external getOSMesaColorBuffer :
+  window:window ->
+  (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array3.t
+  = "caml_glfwGetOSMesaColorBuffer"
+external getOSMesaDepthBuffer : window:window -> osmesa_depth_buffer
+  = "caml_glfwGetOSMesaDepthBuffer"
+
 external destroyWindow : window:window -> unit = "caml_glfwDestroyWindow"
 external windowShouldClose : window:window -> bool
   = "caml_glfwWindowShouldClose"
@@ -487,6 +764,9 @@ external setWindowTitle : window:window -> title:string -> unit
   = "caml_glfwSetWindowTitle"
 external setWindowIcon : window:window -> images:Image.t list -> unit
   = "caml_glfwSetWindowIcon"
+external setWindowIconBigarray :
+  window:window -> images:BigarrayImage.t list -> unit
+  = "caml_setWindowIconBigarray"
 external getWindowPos : window:window -> int * int = "caml_glfwGetWindowPos"
 external setWindowPos : window:window -> xpos:int -> ypos:int -> unit
   = "caml_glfwSetWindowPos"
@@ -567,6 +847,40 @@ external waitEvents : unit -> unit = "caml_glfwWaitEvents"
 external waitEventsTimeout : timeout:float -> unit
   = "caml_glfwWaitEventsTimeout"
 external postEmptyEvent : unit -> unit = "caml_glfwPostEmptyEvent"
+
+(** Returns the file descriptor of the connection to the X11 or Wayland
+    display server, or None on other platforms. Event loops can wait for it
+    to become readable alongside their other descriptors instead of calling
+    waitEvents, then call pollEvents, which dispatches pending events without
+    blocking and leaves none buffered. postEmptyEvent makes the descriptor
+    readable too. With GLFW 3.4, the descriptor of the platform selected at
+    initialization is returned. *)
+external getEventFd : unit -> Unix.file_descr option = "caml_getEventFd"
+
+(** Precise waits. waitUntil processes events like waitEventsTimeout until
+    getTime reaches the deadline, returning true as soon as events woke the
+    thread or false once the deadline is reached. Most of the wait is spent
+    sleeping and the last fraction of a millisecond spinning on the timer,
+    all of it with the OCaml runtime released.
+
+    limitFrame waits until the end of the current frame of a limiter created
+    with the desired frame period in seconds, processing events without
+    returning early, and returns the time elapsed since it last returned so
+    that it can be compared with the period. The first call returns 0. When
+    a whole period is missed, the limiter resumes from the current time
+    rather than trying to catch up. Both functions process events at least
+    once, even when the deadline has already passed.
+
+    @raise Invalid_argument if the period is not positive and finite. *)
+external waitUntil : deadline:(float [@unboxed]) -> bool
+  = "caml_waitUntil" "caml_waitUntil_unboxed"
+external createFrameLimiter : period:float -> frame_limiter
+  = "caml_createFrameLimiter"
+external destroyFrameLimiter : limiter:frame_limiter -> unit
+  = "caml_destroyFrameLimiter"
+external limitFrame : limiter:frame_limiter -> (float [@unboxed])
+  = "caml_limitFrame" "caml_limitFrame_unboxed"
+
 external getInputMode : window:window -> mode:'a input_mode -> 'a
   = "caml_glfwGetInputMode"
 external setInputMode : window:window -> mode:'a input_mode -> value:'a -> unit
@@ -584,16 +898,44 @@ external setCursorPos : window:window -> xpos:float -> ypos:float -> unit
   = "caml_glfwSetCursorPos"
 external createCursor : image:Image.t -> xhot:int -> yhot:int -> cursor
   = "caml_glfwCreateCursor"
+external createCursorBigarray :
+  image:BigarrayImage.t -> xhot:int -> yhot:int -> cursor
+  = "caml_createCursorBigarray"
 external createStandardCursor : shape:cursor_shape -> cursor
   = "caml_glfwCreateStandardCursor"
 external destroyCursor : cursor:cursor -> unit = "caml_glfwDestroyCursor"
 external setCursor : window:window -> cursor:cursor -> unit
   = "caml_glfwSetCursor"
+
+(** Animated cursors. createCursorAnimation creates a cursor for each frame,
+    given with its duration in seconds, all sharing the same hotspot.
+    Identical frames, including frames of other animations, share the same
+    cursor. setCursorAnimation makes a window cycle through the frames of an
+    animation, the cursor being switched on the C side each time events are
+    processed. Setting None, calling setCursor or destroying the animation
+    stops it. Animations must be recreated after the library is terminated.
+
+    @raise Invalid_argument if there are no frames or if a duration is not
+    positive. *)
+external createCursorAnimation :
+  frames:(Image.t * float) array -> xhot:int -> yhot:int -> cursor_animation
+  = "caml_createCursorAnimation"
+external destroyCursorAnimation : animation:cursor_animation -> unit
+  = "caml_destroyCursorAnimation"
+external setCursorAnimation :
+  window:window -> animation:cursor_animation option -> unit
+  = "caml_setCursorAnimation"
+
 external setKeyCallback :
   window:window
   -> f:(window -> key -> int -> key_action -> key_mod list -> unit) option
   -> (window -> key -> int -> key_action -> key_mod list -> unit) option
   = "caml_glfwSetKeyCallback"
+external setKeyCallbackBitset :
+  window:window
+  -> f:(window -> key -> int -> key_action -> KeyModSet.t -> unit) option
+  -> (window -> key -> int -> key_action -> KeyModSet.t -> unit) option
+  = "caml_glfwSetKeyCallbackBitset"
 external setCharCallback :
   window:window -> f:(window -> int -> unit) option
   -> (window -> int -> unit) option
@@ -602,10 +944,18 @@ external setCharModsCallback :
   window:window -> f:(window -> int -> key_mod list -> unit) option
   -> (window -> int -> key_mod list -> unit) option
   = "caml_glfwSetCharModsCallback" [@@deprecated]
+external setCharModsCallbackBitset :
+  window:window -> f:(window -> int -> KeyModSet.t -> unit) option
+  -> (window -> int -> KeyModSet.t -> unit) option
+  = "caml_glfwSetCharModsCallbackBitset" [@@deprecated]
 external setMouseButtonCallback :
   window:window -> f:(window -> int -> bool -> key_mod list -> unit) option
   -> (window -> int -> bool -> key_mod list -> unit) option
   = "caml_glfwSetMouseButtonCallback"
+external setMouseButtonCallbackBitset :
+  window:window -> f:(window -> int -> bool -> KeyModSet.t -> unit) option
+  -> (window -> int -> bool -> KeyModSet.t -> unit) option
+  = "caml_glfwSetMouseButtonCallbackBitset"
 external setCursorPosCallback :
   window:window -> f:(window -> float -> float -> unit) option
   -> (window -> float -> float -> unit) option
@@ -622,12 +972,66 @@ external setDropCallback :
   window:window -> f:(window -> string list -> unit) option
   -> (window -> string list -> unit) option
   = "caml_glfwSetDropCallback"
+
+(** Event queueing. Once enabled on a window, its events are stored in a queue
+    on the C side instead of being passed to its callbacks one by one. The
+    whole queue is then handed over at once, in the order the events arrived,
+    by drainEvents or pollEventsBatch (which polls then drains). This saves a
+    transition from C to OCaml per event.
+
+    Callbacks set on a window are not called for queued events while queueing
+    is enabled, with the exception of the drop and character with modifiers
+    callbacks which are always called directly. Events of a window that are
+    still queued when it is destroyed are discarded. *)
+external setEventQueueing : window:window -> enabled:bool -> unit
+  = "caml_setEventQueueing"
+external getEventQueueing : window:window -> bool = "caml_getEventQueueing"
+external drainEvents : unit -> event array = "caml_drainEvents"
+external pollEventsBatch : unit -> event array = "caml_pollEventsBatch"
+
+(** Event coalescing. Events of a type with a coalescing policy other than
+    NoCoalescing are retained on the C side and delivered at most once per call
+    to pollEvents, pollEventsBatch, waitEvents or waitEventsTimeout, after all
+    the other events. They go through the event queue if it is enabled on the
+    window, or else are passed to the corresponding callback.
+
+    @raise Invalid_argument if Accumulate is used with events other than
+    ScrollEvents. *)
+external setEventCoalescing :
+  window:window -> event:coalescable_event -> policy:coalescing_policy -> unit
+  = "caml_setEventCoalescing"
+external getEventCoalescing :
+  window:window -> event:coalescable_event -> coalescing_policy
+  = "caml_getEventCoalescing"
+
+(** Input tracking. While enabled on a window, its keyboard key and mouse
+    button states are maintained on the C side, regardless of the callbacks
+    set, and can be copied into an InputState.t with getInputSnapshot. This
+    replaces a getKey call per key per frame with a single call. *)
+external setInputTracking : window:window -> enabled:bool -> unit
+  = "caml_setInputTracking"
+external getInputTracking : window:window -> bool = "caml_getInputTracking"
+external getInputSnapshot : window:window -> state:InputState.t -> unit
+  = "caml_getInputSnapshot_noalloc" [@@noalloc]
+
+(** Frame statistics. While enabled on a window, each swapBuffers on it ends
+    a frame and records its duration since the previous one, the time
+    swapBuffers blocked, the time spent in pollEvents and pollEventsBatch
+    (callbacks included) and the time the callbacks of the window ran,
+    whichever event processing function dispatched them. Only the last 256
+    frames are kept. Enabling collection again clears them. Percentiles are
+    read with Noalloc.getFrameStatsInto. *)
+external setFrameStatsCollection : window:window -> enabled:bool -> unit
+  = "caml_setFrameStatsCollection"
+
 external joystickPresent : joy:int -> bool = "caml_glfwJoystickPresent"
 external getJoystickAxes : joy:int -> float array = "caml_glfwGetJoystickAxes"
 external getJoystickButtons : joy:int -> bool array
   = "caml_glfwGetJoystickButtons"
 external getJoystickHats : joy:int -> hat_status list array
   = "caml_glfwGetJoystickHats"
+external getJoystickHatsBitset : joy:int -> HatStatusSet.t array
+  = "caml_glfwGetJoystickHatsBitset"
 external getJoystickName : joy:int -> string option = "caml_glfwGetJoystickName"
 external getJoystickGUID : joy:int -> string option = "caml_glfwGetJoystickGUID"
 external joystickIsGamepad : joy:int -> bool = "caml_glfwJoystickIsGamepad"
@@ -642,10 +1046,41 @@ external getGamepadState : joy:int -> gamepad_state = "caml_glfwGetGamepadState"
 external setClipboardString : window:_ -> string:string -> unit
   = "caml_glfwSetClipboardString"
 external getClipboardString : window:_ -> string = "caml_glfwGetClipboardString"
-external getTime : unit -> float = "caml_glfwGetTime"
-external setTime : time:float -> unit = "caml_glfwSetTime"
-external getTimerValue : unit -> int64 = "caml_glfwGetTimerValue"
-external getTimerFrequency : unit -> int64 = "caml_glfwGetTimerFrequency"
+
+(** Clipboard transfers through Bigarrays, avoiding intermediate OCaml
+    strings. getClipboardBigarray copies the clipboard contents at the start
+    of buffer if it is large enough and returns their length in any case, so
+    that a larger buffer can be supplied when needed.
+
+    getClipboardBigarrayIfChanged does the same but returns -1 without
+    copying anything if the contents are the same as those last copied by
+    this function.
+
+    setClipboardBigarray sets the clipboard contents to the first length
+    bytes of data, which must not contain NUL bytes. data is never written
+    to.
+
+    @raise Invalid_argument if length is negative or larger than data. *)
+external getClipboardBigarray :
+  buffer:(char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+  -> int
+  = "caml_getClipboardBigarray"
+external getClipboardBigarrayIfChanged :
+  buffer:(char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+  -> int
+  = "caml_getClipboardBigarrayIfChanged"
+val setClipboardBigarray :
+  data:(char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+  -> length:int -> unit
+
+external getTime : unit -> (float [@unboxed])
+  = "caml_glfwGetTime" "caml_glfwGetTime_unboxed"
+external setTime : time:(float [@unboxed]) -> unit
+  = "caml_glfwSetTime" "caml_glfwSetTime_unboxed"
+external getTimerValue : unit -> (int64 [@unboxed])
+  = "caml_glfwGetTimerValue" "caml_glfwGetTimerValue_unboxed"
+external getTimerFrequency : unit -> (int64 [@unboxed])
+  = "caml_glfwGetTimerFrequency" "caml_glfwGetTimerFrequency_unboxed"
 external makeContextCurrent : window:window option -> unit
   = "caml_glfwMakeContextCurrent"
 external getCurrentContext : unit -> window option
@@ -654,3 +1089,266 @@ external swapBuffers : window:window -> unit = "caml_glfwSwapBuffers"
 external swapInterval : interval:int -> unit = "caml_glfwSwapInterval"
 external extensionSupported : extension:string -> bool
   = "caml_glfwExtensionSupported"
+external getProcAddress : procname:string -> nativeint option
+  = "caml_glfwGetProcAddress"
+
+(** GL function pointer tables. createProcTable resolves the functions whose
+    names are given, in that order, into a contiguous array of pointers whose
+    address is returned by getProcTableAddress for use by C stubs. Tables
+    are resolved when created if a context is current and again when
+    makeContextCurrent switches to a context whose client API, creation API,
+    version, profile or forward compatibility differ from those the table
+    was resolved for. Unresolved functions have a null address. *)
+external createProcTable : names:string array -> proc_table
+  = "caml_createProcTable"
+external destroyProcTable : table:proc_table -> unit = "caml_destroyProcTable"
+external getProcTableEntry : table:proc_table -> index:int -> nativeint
+  = "caml_getProcTableEntry"
+external getProcTableAddress : table:proc_table -> nativeint
+  = "caml_getProcTableAddress"
+
+(** Draws an image over the whole framebuffer of a window, scaling it if
+    needed, then swaps its buffers. The context of the window is made current
+    if it was not already. The optional damage rectangles, given as
+    (x, y, width, height) with the origin at the top left of the image, limit
+    the upload to the parts of the image that changed since the previous call
+    on this window; the whole image is uploaded when omitted or when its size
+    changed. The OCaml runtime is released during the upload and the swap.
+
+    @raise ApiUnavailable if the context does not support framebuffer
+    objects. *)
+external presentPixels :
+  window:window -> image:BigarrayImage.t ->
+  damage:(int * int * int * int) array option -> unit
+  = "caml_presentPixels"
+
+(** Asynchronous frame capture. Once startCapture has been called on a
+    window, each swapBuffers made while its context is current reads the
+    back buffer into the next of a ring of buffers, from which frames become
+    available buffers - 1 swaps later without stalling. getCapturedFrame
+    returns the frame made available by the last swapBuffers, with
+    dimensions height, width and 4 and rows stored bottom to top. The
+    Bigarray aliases a mapped GL buffer and must not be used after the next
+    swapBuffers or stopCapture on the window.
+
+    When an output is given, frames are also written to it by a separate
+    thread. Frames are dropped rather than blocking when that thread falls
+    behind, as counted by getCaptureDroppedFrames, and frames whose size
+    differs from the first one are skipped. stopCapture reads the frames
+    still in flight and waits for all of them to be written. The OCaml
+    runtime is released meanwhile. terminate stops every capture in the same
+    way, while destroyWindow drops the frames still in flight.
+
+    @raise Invalid_argument if buffers is not between 1 and 16 or the window
+    is already capturing.
+    @raise ApiUnavailable if the context does not support pixel buffer
+    objects, or if an output file is given and the stubs were built without
+    POSIX threads.
+    @raise Sys_error if the output file cannot be opened. *)
+external startCapture :
+  window:window -> buffers:int -> output:capture_output option -> unit
+  = "caml_startCapture"
+external stopCapture : window:window -> unit = "caml_stopCapture"
+external getCapturedFrame :
+  window:window ->
+  (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array3.t option
+  = "caml_getCapturedFrame"
+external getCaptureDroppedFrames : window:window -> int
+  = "caml_getCaptureDroppedFrames"
+
+(** Vulkan support. getInstanceProcAddress returns the address of the
+    requested function, if any, for use with the loader of a Vulkan binding.
+    createWindowSurface returns the VkSurfaceKHR handle of the new surface,
+    which must be destroyed with vkDestroySurfaceKHR before the window.
+    Handles created by a Vulkan binding are converted to and from their raw
+    pointer value with the vk*OfNativeint and nativeintOf* functions. *)
+external vulkanSupported : unit -> bool = "caml_glfwVulkanSupported"
+external getRequiredInstanceExtensions : unit -> string array
+  = "caml_glfwGetRequiredInstanceExtensions"
+external getInstanceProcAddress :
+  instance:vk_instance option -> procname:string -> nativeint option
+  = "caml_glfwGetInstanceProcAddress"
+external getPhysicalDevicePresentationSupport :
+  instance:vk_instance -> device:vk_physical_device -> queuefamily:int -> bool
+  = "caml_glfwGetPhysicalDevicePresentationSupport"
+external createWindowSurface : instance:vk_instance -> window:window -> int64
+  = "caml_glfwCreateWindowSurface"
+external vkInstanceOfNativeint : nativeint -> vk_instance
+  = "caml_vkInstanceOfNativeint"
+external nativeintOfVkInstance : vk_instance -> nativeint
+  = "caml_nativeintOfVkInstance"
+external vkPhysicalDeviceOfNativeint : nativeint -> vk_physical_device
+  = "caml_vkPhysicalDeviceOfNativeint"
+external nativeintOfVkPhysicalDevice : vk_physical_device -> nativeint
+  = "caml_nativeintOfVkPhysicalDevice"
+
+(** Allocation-free variants of frequently called functions, for use in
+    steady-state frame loops. These never raise GLFW exceptions: errors are
+    silently ignored and the default values GLFW returns in that case (false,
+    zero) are passed along instead.
+
+    getTimerNanoseconds returns the value of the GLFW timer converted to
+    nanoseconds. The *Into functions store the two elements of their result in
+    the first two elements of the supplied buffer, except getFrameStatsInto
+    which stores in its first twelve elements the 50th, 95th and 99th
+    percentiles in seconds of the frame time, swap time, polling time and
+    callback time collected for the window, in that order, or zeros when no
+    frame was recorded.
+
+    @raise Invalid_argument if the buffer passed to an *Into function has less
+    than two elements, or twelve for getFrameStatsInto. *)
+module Noalloc :
+  sig
+    external getTime : unit -> (float [@unboxed])
+      = "caml_glfwGetTime_noalloc_byte" "caml_glfwGetTime_noalloc"
+      [@@noalloc]
+    external getTimerNanoseconds : unit -> (int [@untagged])
+      = "caml_getTimerNanoseconds_noalloc_byte"
+        "caml_getTimerNanoseconds_noalloc"
+      [@@noalloc]
+    external windowShouldClose : window:window -> bool
+      = "caml_glfwWindowShouldClose_noalloc" [@@noalloc]
+    external getKey : window:window -> key:key -> bool
+      = "caml_glfwGetKey_noalloc" [@@noalloc]
+    external getMouseButton : window:window -> button:int -> bool
+      = "caml_glfwGetMouseButton_noalloc" [@@noalloc]
+    val getCursorPosInto :
+      window:window
+      -> pos:(float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array1.t
+      -> unit
+    val getWindowSizeInto : window:window -> size:int array -> unit
+    val getFramebufferSizeInto : window:window -> size:int array -> unit
+    val getFrameStatsInto :
+      window:window
+      -> stats:
+           (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array1.t
+      -> unit
+  end
+
+(** Variants of failure-prone functions which are called every frame, such as
+    joystick, gamepad, input and window geometry queries, which report errors
+    through their return value instead of raising an exception. The error
+    constructors correspond to the GLFW exceptions of the same name.
+
+    The error description is not built unless getErrorDescription is called.
+    It returns the description of the last error which occurred on the
+    calling thread. *)
+module Unchecked :
+  sig
+    type error =
+      | NotInitialized
+      | NoCurrentContext
+      | InvalidEnum
+      | InvalidValue
+      | OutOfMemory
+      | ApiUnavailable
+      | VersionUnavailable
+      | PlatformError
+      | FormatUnavailable
+      | NoWindowContext
+
+    external getErrorDescription : unit -> string
+      = "caml_getErrorDescription"
+
+    external joystickPresent : joy:int -> (bool, error) result
+      = "caml_glfwJoystickPresent_unchecked"
+    external getJoystickAxes : joy:int -> (float array, error) result
+      = "caml_glfwGetJoystickAxes_unchecked"
+    external getJoystickButtons : joy:int -> (bool array, error) result
+      = "caml_glfwGetJoystickButtons_unchecked"
+    external getJoystickHats : joy:int -> (hat_status list array, error) result
+      = "caml_glfwGetJoystickHats_unchecked"
+    external getJoystickHatsBitset :
+      joy:int -> (HatStatusSet.t array, error) result
+      = "caml_glfwGetJoystickHatsBitset_unchecked"
+    external getJoystickName : joy:int -> (string option, error) result
+      = "caml_glfwGetJoystickName_unchecked"
+    external getJoystickGUID : joy:int -> (string option, error) result
+      = "caml_glfwGetJoystickGUID_unchecked"
+    external joystickIsGamepad : joy:int -> (bool, error) result
+      = "caml_glfwJoystickIsGamepad_unchecked"
+    external getGamepadName : joy:int -> (string option, error) result
+      = "caml_glfwGetGamepadName_unchecked"
+    external getGamepadState : joy:int -> (gamepad_state, error) result
+      = "caml_glfwGetGamepadState_unchecked"
+    external getKey : window:window -> key:key -> (bool, error) result
+      = "caml_glfwGetKey_unchecked"
+    external getMouseButton :
+      window:window -> button:int -> (bool, error) result
+      = "caml_glfwGetMouseButton_unchecked"
+    external getCursorPos : window:window -> (float * float, error) result
+      = "caml_glfwGetCursorPos_unchecked"
+    external getWindowPos : window:window -> (int * int, error) result
+      = "caml_glfwGetWindowPos_unchecked"
+    external getWindowSize : window:window -> (int * int, error) result
+      = "caml_glfwGetWindowSize_unchecked"
+    external getFramebufferSize : window:window -> (int * int, error) result
+      = "caml_glfwGetFramebufferSize_unchecked"
+    external getWindowFrameSize :
+      window:window -> (int * int * int * int, error) result
+      = "caml_glfwGetWindowFrameSize_unchecked"
+    external getWindowContentScale :
+      window:window -> (float * float, error) result
+      = "caml_glfwGetWindowContentScale_unchecked"
+  end
+
+(** Instrumentation of the C stubs, counting the calls, cumulative time and
+    latency histogram of every GLFW function binding and of every callback
+    stub, along with the minor words allocated by the OCaml callbacks each
+    callback stub dispatches. Profiling is disabled by default and costs a
+    single branch per call until it is enabled, either by calling enable or by
+    setting the GLFW_OCAML_PROFILE environment variable to a value other than
+    0, in which case report is printed on the standard error at exit. It has
+    no effect if the stubs were compiled with ML_NO_PROFILE or without GCC
+    extensions. The time of calls which raise an exception is not recorded.
+    Events retained by setEventCoalescing are counted by the coalesce_event
+    entry when they arrive, and by their callback stub once delivered.
+
+    getStats returns the names of the stubs called since the last reset along
+    with a matrix holding one row for each of them: the number of calls, the
+    cumulative time in seconds, the minor words allocated by callbacks, then
+    histogramBuckets counts where bucket k holds the calls which took less
+    than 2{^k+1} nanoseconds but not less than 2{^k}, the last bucket also
+    holding any slower call. report formats these as a table sorted by
+    cumulative time, with percentiles estimated from the histogram. *)
+module Profile :
+  sig
+    val histogramBuckets : int
+    val enable : unit -> unit
+    val disable : unit -> unit
+    external isEnabled : unit -> bool = "caml_isProfiling" [@@noalloc]
+    external reset : unit -> unit = "caml_resetProfile" [@@noalloc]
+    external getStats :
+      unit
+      -> string array
+         * (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array2.t
+      = "caml_getProfile"
+    val report : unit -> string
+  end
+
+(** Tracing of the individual calls of the callback stubs, of the functions
+    processing or waiting for events and of swapBuffers, for inspection in a
+    viewer such as Perfetto or chrome://tracing. start allocates a ring of
+    capacity spans, each recorded without locking when its call returns, the
+    most recent spans overwriting the oldest ones once the ring is full. write
+    saves them to a file in the Chrome trace event format, along with the
+    number of spans which were overwritten or dropped because another thread
+    was writing to the same slot; tracing must be stopped first, and start and
+    write wait for the calls still recording a span to finish.
+    Setting the GLFW_OCAML_TRACE environment variable to a file path starts
+    tracing with a capacity of 262144 spans when the library is loaded and
+    writes the trace to that file at exit.
+
+    Tracing shares the instrumentation of the Profile module: when it is
+    disabled each call costs a single branch.
+
+    @raise ApiUnavailable if the stubs were compiled without instrumentation.
+    @raise Invalid_argument if capacity is not positive or if start or write
+    is called while tracing.
+    @raise Sys_error if the trace file cannot be written. *)
+module Trace :
+  sig
+    external start : capacity:int -> unit = "caml_startTrace"
+    external stop : unit -> unit = "caml_stopTrace" [@@noalloc]
+    external write : path:string -> unit = "caml_writeTrace"
+  end
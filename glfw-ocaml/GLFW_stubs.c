@@ -1,19 +1,42 @@
 #include <GLFW/glfw3.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
 #include <caml/mlvalues.h>
 #include <caml/alloc.h>
 #include <caml/memory.h>
 #include <caml/fail.h>
 #include <caml/callback.h>
+#include <caml/signals.h>
 #include <caml/bigarray.h>
 #include <assert.h>
 
+/* POSIX threads, only used by the writer thread of frame captures. */
+#ifndef _MSC_VER
+# define ML_PTHREADS
+# include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define ML_X86_SIMD
+# include <emmintrin.h>
+# include <tmmintrin.h>
+#endif
+
 #ifdef CAMLunused_start /* Introduced in OCaml 4.03 */
 # define CAMLvoid CAMLunused_start value unit CAMLunused_end
 #else
 # define CAMLvoid CAMLunused value unit
 #endif
 
+#ifndef Bytes_val /* Introduced in OCaml 4.06 */
+# define Bytes_val(x) ((unsigned char*)Bp_val(x))
+#endif
+
 #ifndef Val_none /* These definitions appeared in OCaml 4.12 */
 # define Val_none Val_int(0)
 # define Some_val(v) Field(v, 0)
@@ -44,6 +67,7 @@ static value Val_cptr(void* p)
 #define CAML_SETTER_STUB(glfw_setter, name)                             \
     CAMLprim value caml_##glfw_setter(value new_closure)                \
     {                                                                   \
+        ML_PROFILE();                                                   \
         CAMLparam1(new_closure);                                        \
         CAMLlocal1(previous_closure);                                   \
                                                                         \
@@ -96,22 +120,139 @@ struct ml_window_callbacks
     value cursor_enter;
     value scroll;
     value drop;
+    value key_bitset;
+    value character_mods_bitset;
+    value mouse_button_bitset;
 };
 
 #define ML_WINDOW_CALLBACKS_WOSIZE \
     (sizeof(struct ml_window_callbacks) / sizeof(value))
 
-#define CAML_WINDOW_SETTER_STUB(glfw_setter, name)                      \
-    CAMLprim value caml_##glfw_setter(value ml_window, value new_closure) \
+#define ML_CALLBACK_BIT(name) \
+    (1u << offsetof(struct ml_window_callbacks, name) / sizeof(value))
+
+/* Events that can be stored in the event queue instead of being passed
+   to their callback right away. Drop events carry a variable amount of
+   data and character with modifiers events are deprecated, so both are
+   always passed to their callback. */
+#define ML_QUEUEABLE_CALLBACKS                                          \
+    (((1u << ML_WINDOW_CALLBACKS_WOSIZE) - 1)                           \
+     & ~ML_CALLBACK_BIT(character_mods)                                 \
+     & ~ML_CALLBACK_BIT(character_mods_bitset) & ~ML_CALLBACK_BIT(drop))
+
+/* Events which can be coalesced, in the same order as the constructors of
+   the coalescable_event type. */
+enum ml_coalescable_event
+{
+    CoalescedWindowPos,
+    CoalescedWindowSize,
+    CoalescedFramebufferSize,
+    CoalescedCursorPos,
+    CoalescedScroll,
+    CoalescableEventCount
+};
+
+/* Same order as the constructors of the coalescing_policy type. */
+enum ml_coalescing_policy
+{
+    NoCoalescing,
+    LatestWins,
+    Accumulate
+};
+
+struct ml_coalesced_event
+{
+    enum ml_coalescing_policy policy;
+    int pending;
+    double x, y;
+};
+
+/* Keyboard key and mouse button states of a window, indexed by the OCaml
+   values of keys and buttons. The pressed and released bitmaps only hold
+   the transitions which occurred during the last event processing. This
+   structure is copied as is into InputState.t values, whose accessors
+   assume this exact layout. */
+#define ML_KEY_BITMAP_SIZE 32
+
+struct ml_input_state
+{
+    unsigned char keys_down[ML_KEY_BITMAP_SIZE];
+    unsigned char keys_pressed[ML_KEY_BITMAP_SIZE];
+    unsigned char keys_released[ML_KEY_BITMAP_SIZE];
+    unsigned char buttons_down;
+    unsigned char buttons_pressed;
+    unsigned char buttons_released;
+};
+
+/* Context attributes identifying which functions a driver exposes, so that
+   GL function pointers are only resolved again when they differ. */
+static const int context_signature_attribs[] = {
+    GLFW_CLIENT_API, GLFW_CONTEXT_CREATION_API, GLFW_CONTEXT_VERSION_MAJOR,
+    GLFW_CONTEXT_VERSION_MINOR, GLFW_OPENGL_PROFILE, GLFW_OPENGL_FORWARD_COMPAT
+};
+
+#define ML_CONTEXT_SIGNATURE_SIZE \
+    (sizeof(context_signature_attribs) / sizeof(*context_signature_attribs))
+
+/* Texture and framebuffer object used by presentPixels, created the first
+   time it is called on a window. */
+struct ml_presenter
+{
+    unsigned int texture;
+    unsigned int framebuffer;
+    int width;
+    int height;
+};
+
+/* The window user pointer points to this structure. Its first member
+   being the OCaml block holding the callbacks, it may also be
+   dereferenced as a pointer to struct ml_window_callbacks. */
+struct ml_window_data
+{
+    value callbacks;
+    GLFWwindow* window;
+    int queue_events;
+    unsigned int forced_callbacks;
+    struct ml_coalesced_event coalesced[CoalescableEventCount];
+    int has_pending_events;
+    struct ml_window_data* next_pending;
+    int track_input;
+    unsigned int input_epoch;
+    struct ml_input_state input_state;
+    struct ml_cursor_animation* cursor_animation;
+    unsigned int cursor_frame;
+    double cursor_frame_start;
+    struct ml_window_data* next_animated;
+    int context_signature[ML_CONTEXT_SIGNATURE_SIZE];
+    struct ml_presenter presenter;
+    struct ml_capture* capture;
+    struct ml_window_data* next_capturing;
+    struct ml_frame_stats* frame_stats;
+};
+
+#define Window_data(window) \
+    ((struct ml_window_data*)glfwGetWindowUserPointer(window))
+
+#define Window_callbacks(window) \
+    ((struct ml_window_callbacks*)Window_data(window)->callbacks)
+
+/* Some events can be passed to either of two callbacks, which then share
+   the same stub. The stub must remain installed as long as one of them is
+   set or the window needs it for some other reason. */
+#define CAML_WINDOW_SHARED_SETTER_STUB(ml_setter, glfw_setter, name, shared, \
+                                       stub)                            \
+    CAMLprim value ml_setter(value ml_window, value new_closure)        \
     {                                                                   \
+        ML_PROFILE();                                                   \
         CAMLparam1(new_closure);                                        \
         CAMLlocal1(previous_closure);                                   \
         GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);          \
-        struct ml_window_callbacks* ml_window_callbacks =               \
-            *(struct ml_window_callbacks**)                             \
+        struct ml_window_data* ml_window_data =                         \
             glfwGetWindowUserPointer(window);                           \
                                                                         \
         raise_if_error();                                               \
+        struct ml_window_callbacks* ml_window_callbacks =               \
+            (struct ml_window_callbacks*)ml_window_data->callbacks;     \
         if (ml_window_callbacks->name == Val_unit)                      \
             previous_closure = Val_none;                                \
         else                                                            \
@@ -120,19 +261,27 @@ struct ml_window_callbacks
         {                                                               \
             if (ml_window_callbacks->name != Val_unit)                  \
             {                                                           \
-                glfw_setter(window, NULL);                              \
                 ml_window_callbacks->name = Val_unit;                   \
+                if (ml_window_callbacks->shared == Val_unit             \
+                    && !(ml_window_data->forced_callbacks               \
+                         & (ML_CALLBACK_BIT(name)                       \
+                            | ML_CALLBACK_BIT(shared))))                \
+                    glfw_setter(window, NULL);                          \
             }                                                           \
         }                                                               \
         else                                                            \
         {                                                               \
             if (ml_window_callbacks->name == Val_unit)                  \
-                glfw_setter(window, name##_callback_stub);              \
+                glfw_setter(window, stub##_callback_stub);              \
             caml_modify(&ml_window_callbacks->name, Some_val(new_closure)); \
         }                                                               \
         CAMLreturn(previous_closure);                                   \
     }
 
+#define CAML_WINDOW_SETTER_STUB(glfw_setter, name)                      \
+    CAML_WINDOW_SHARED_SETTER_STUB(                                     \
+        caml_##glfw_setter, glfw_setter, name, name, name)
+
 enum value_type
 {
     Int,
@@ -223,6 +372,10 @@ static inline value caml_list_of_pointer_array(void** array, int count)
     CAMLreturn(ret);
 }
 
+/* Modifier bits matching the constructors of the key_mod type. */
+#define ML_KEY_MOD_MASK \
+    (GLFW_MOD_SHIFT | GLFW_MOD_CONTROL | GLFW_MOD_ALT | GLFW_MOD_SUPER)
+
 static inline value caml_list_of_flags(int flags, int count)
 {
     CAMLparam0();
@@ -252,81 +405,604 @@ static inline value caml_copy_vidmode(const GLFWvidmode* vidmode)
     return v;
 }
 
-static value error_tag = Val_unit;
-static value error_arg = Val_unit;
+/* The constructors of the event type in the same order, so their values
+   are also the tags of the corresponding OCaml blocks. */
+enum ml_event_type
+{
+    WindowPosEvent,
+    WindowSizeEvent,
+    WindowCloseEvent,
+    WindowRefreshEvent,
+    WindowFocusEvent,
+    WindowIconifyEvent,
+    WindowMaximizeEvent,
+    FramebufferSizeEvent,
+    WindowContentScaleEvent,
+    KeyEvent,
+    CharEvent,
+    MouseButtonEvent,
+    CursorPosEvent,
+    CursorEnterEvent,
+    ScrollEvent
+};
 
-static void error_callback(int error, const char* description)
+struct ml_event
 {
-    switch (error)
+    GLFWwindow* window;
+    enum ml_event_type type;
+    union
     {
-    case GLFW_NOT_INITIALIZED:
-        error_tag = *caml_named_value("GLFW.NotInitialized");
-        break;
-    case GLFW_NO_CURRENT_CONTEXT:
-        error_tag = *caml_named_value("GLFW.NoCurrentContext");
-        break;
-    case GLFW_INVALID_ENUM:
-        error_tag = *caml_named_value("GLFW.InvalidEnum");
-        break;
-    case GLFW_INVALID_VALUE:
-        error_tag = *caml_named_value("GLFW.InvalidValue");
-        break;
-    case GLFW_OUT_OF_MEMORY:
-        error_tag = *caml_named_value("GLFW.OutOfMemory");
-        break;
-    case GLFW_API_UNAVAILABLE:
-        error_tag = *caml_named_value("GLFW.ApiUnavailable");
-        break;
-    case GLFW_VERSION_UNAVAILABLE:
-        error_tag = *caml_named_value("GLFW.VersionUnavailable");
-        break;
-    case GLFW_PLATFORM_ERROR:
-        error_tag = *caml_named_value("GLFW.PlatformError");
-        break;
-    case GLFW_FORMAT_UNAVAILABLE:
-        error_tag = *caml_named_value("GLFW.FormatUnavailable");
-        break;
-    case GLFW_NO_WINDOW_CONTEXT:
-        error_tag = *caml_named_value("GLFW.NoWindowContext");
+        int i[4];
+        double d[2];
+    } args;
+};
+
+static struct ml_event* event_queue = NULL;
+static size_t event_queue_length = 0;
+static size_t event_queue_capacity = 0;
+
+/* Returns the next free record of the event queue, growing it if needed,
+   or NULL if memory is exhausted. In that case the event is dropped since
+   there is no way to report an error from inside a callback. */
+static struct ml_event* push_event(GLFWwindow* window, enum ml_event_type type)
+{
+    struct ml_event* event;
+
+    if (event_queue_length == event_queue_capacity)
+    {
+        size_t new_capacity =
+            event_queue_capacity == 0 ? 256 : event_queue_capacity * 2;
+        struct ml_event* new_queue =
+            realloc(event_queue, new_capacity * sizeof(*event_queue));
+
+        if (new_queue == NULL)
+            return NULL;
+        event_queue = new_queue;
+        event_queue_capacity = new_capacity;
+    }
+    event = event_queue + event_queue_length++;
+    event->window = window;
+    event->type = type;
+    return event;
+}
+
+static void push_int_event(
+    GLFWwindow* window, enum ml_event_type type, int a, int b, int c, int d)
+{
+    struct ml_event* event = push_event(window, type);
+
+    if (event == NULL)
+        return;
+    event->args.i[0] = a;
+    event->args.i[1] = b;
+    event->args.i[2] = c;
+    event->args.i[3] = d;
+}
+
+static void push_double_event(
+    GLFWwindow* window, enum ml_event_type type, double x, double y)
+{
+    struct ml_event* event = push_event(window, type);
+
+    if (event == NULL)
+        return;
+    event->args.d[0] = x;
+    event->args.d[1] = y;
+}
+
+/* Events of a destroyed window must not be handed over to OCaml. */
+static void purge_window_events(GLFWwindow* window)
+{
+    size_t j = 0;
+
+    for (size_t i = 0; i < event_queue_length; ++i)
+        if (event_queue[i].window != window)
+            event_queue[j++] = event_queue[i];
+    event_queue_length = j;
+}
+
+/* Windows with coalesced events waiting to be delivered at the end of the
+   current pollEvents or waitEvents call. */
+static struct ml_window_data* pending_windows = NULL;
+/* Set while delivering coalesced events, so the callback stubs do not
+   coalesce them again. Both this flag and delivering_window are reset when
+   events are next processed, in case a callback raised an exception. */
+static int delivering_coalesced_events = 0;
+/* The window whose coalesced events are being delivered, reset to NULL if
+   it gets destroyed by one of its callbacks. */
+static struct ml_window_data* delivering_window = NULL;
+
+static void remove_pending_window(struct ml_window_data* ml_window_data)
+{
+    struct ml_window_data** iter = &pending_windows;
+
+    if (delivering_window == ml_window_data)
+        delivering_window = NULL;
+    if (!ml_window_data->has_pending_events)
+        return;
+    while (*iter != ml_window_data)
+        iter = &(*iter)->next_pending;
+    *iter = ml_window_data->next_pending;
+    ml_window_data->has_pending_events = 0;
+}
+
+static void flush_coalesced_events(void);
+static void advance_cursor_animations(void);
+static void stop_cursor_animation(struct ml_window_data* ml_window_data);
+static void stop_cursor_animations(void);
+static void invalidate_cursor_cache(void);
+static void unload_proc_tables(void);
+static void capture_frame(GLFWwindow* window, struct ml_capture* capture);
+static struct ml_capture* detach_capture(
+    struct ml_window_data* ml_window_data);
+static void free_capture(struct ml_capture* capture);
+static void stop_captures(void);
+static void free_frame_stats(struct ml_window_data* ml_window_data);
+static void forget_frame_stats(void);
+
+/* Incremented each time events are processed. Windows whose input epoch
+   lags behind have their pressed and released bitmaps cleared lazily. */
+static unsigned int input_epoch = 0;
+
+static void sync_input_edges(struct ml_window_data* ml_window_data)
+{
+    struct ml_input_state* state = &ml_window_data->input_state;
+
+    if (ml_window_data->input_epoch == input_epoch)
+        return;
+    memset(state->keys_pressed, 0, sizeof(state->keys_pressed));
+    memset(state->keys_released, 0, sizeof(state->keys_released));
+    state->buttons_pressed = 0;
+    state->buttons_released = 0;
+    ml_window_data->input_epoch = input_epoch;
+}
+
+static void track_input(
+    unsigned char* down, unsigned char* pressed, unsigned char* released,
+    unsigned int index, int action)
+{
+    const unsigned char mask = 1 << (index & 7);
+
+    index >>= 3;
+    if (action == GLFW_PRESS)
+    {
+        down[index] |= mask;
+        pressed[index] |= mask;
+    }
+    else if (action == GLFW_RELEASE)
+    {
+        down[index] &= ~mask;
+        released[index] |= mask;
     }
-    error_arg = caml_copy_string(description);
+}
+
+#if defined(_MSC_VER)
+# define ML_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+# define ML_THREAD_LOCAL _Thread_local
+#else
+# define ML_THREAD_LOCAL __thread
+#endif
+
+/* The error callback must not touch the OCaml heap: it may be called from
+   stubs declared noalloc. The exception is only built by raise_if_error.
+   GLFW calls the error callback on the thread which caused the error, so
+   keeping the error state thread-local lets several domains or threads call
+   GLFW without getting each other's errors. */
+static ML_THREAD_LOCAL int error_code = GLFW_NO_ERROR;
+static ML_THREAD_LOCAL char error_description[1024];
+
+/* Exceptions registered from OCaml, indexed by error code starting from
+   GLFW_NOT_INITIALIZED. Looked up once by init_stub. */
+static const value*
+    error_tags[GLFW_NO_WINDOW_CONTEXT - GLFW_NOT_INITIALIZED + 1];
+
+static void error_callback(int error, const char* description)
+{
+    error_code = error;
+    strncpy(error_description, description, sizeof(error_description) - 1);
+    error_description[sizeof(error_description) - 1] = '\0';
+}
+
+static inline void clear_error(void)
+{
+    error_code = GLFW_NO_ERROR;
+}
+
+/* Maps the current error code to the index of its OCaml counterpart.
+   Unknown codes are reported as platform errors. */
+static inline unsigned int error_offset(void)
+{
+    unsigned int offset = error_code - GLFW_NOT_INITIALIZED;
+
+    if (offset >= sizeof(error_tags) / sizeof(*error_tags))
+        offset = GLFW_PLATFORM_ERROR - GLFW_NOT_INITIALIZED;
+    return offset;
 }
 
 static inline void raise_if_error(void)
 {
-    if (error_tag != Val_unit)
+    if (error_code != GLFW_NO_ERROR)
+    {
+        unsigned int offset = error_offset();
+
+        clear_error();
+        caml_raise_with_string(*error_tags[offset], error_description);
+    }
+}
+
+/* glfwWaitEvents, glfwWaitEventsTimeout and glfwSwapBuffers run inside a
+   blocking section so that other threads can use the OCaml runtime while the
+   main thread sleeps. Callback stubs fired during such a call take the runtime
+   back before touching any OCaml value and keep it until the call returns, as
+   an exception raised by the callback unwinds straight to OCaml code. */
+static ML_THREAD_LOCAL int runtime_released = 0;
+
+static inline void release_runtime(void)
+{
+    runtime_released = 1;
+    caml_enter_blocking_section();
+}
+
+static inline void acquire_runtime(void)
+{
+    if (runtime_released)
+    {
+        runtime_released = 0;
+        caml_leave_blocking_section();
+    }
+}
+
+/* Opt-in instrumentation of the stubs, enabled by setting the
+   GLFW_OCAML_PROFILE environment variable or by Profile.enable. Each stub
+   declares its own entry, which is linked to the list of entries the first
+   time it is called while profiling is enabled. Otherwise the cost of a stub
+   entry is a single predicted branch, and nothing at all when compiled with
+   ML_NO_PROFILE or by a compiler lacking the cleanup attribute. Calls which
+   raise an exception are counted but their time is not recorded. Bucket k of
+   the latency histogram counts the calls which took between 2^k and
+   2^(k+1) nanoseconds, the last bucket also counting slower ones. Boxed and
+   bytecode stubs which only forward to another stub declare no entry, so
+   that each call is counted once, under the name of the stub doing the
+   work. */
+#define ML_PROFILE_BUCKETS 32
+
+struct ml_profile_entry
+{
+    const char* name;
+    struct ml_profile_entry* next;
+    int registered;
+    uint64_t calls;
+    uint64_t total_ns;
+    double minor_words;
+    uint64_t histogram[ML_PROFILE_BUCKETS];
+};
+
+/* Instrumentation modes, either of which makes the stub scopes active. */
+enum ml_instrumentation
+{
+    InstrumentProfile = 1,
+    InstrumentTrace = 2
+};
+
+/* Kinds of stub scope. Only traced scopes record spans while tracing. */
+enum ml_scope_kind
+{
+    ScopeCallback = 1,
+    ScopeTraced = 2
+};
+
+struct ml_profile_scope
+{
+    struct ml_profile_entry* entry;
+    struct ml_profile_entry* previous_callback;
+    uint64_t start;
+    int active;
+};
+
+static int instrumentation = 0;
+static struct ml_profile_entry* profile_entries = NULL;
+
+/* Spans of the traced scopes, in order of completion, written to a ring
+   allocated by startTrace so that the most recent ones are kept. Writers
+   claim an index with a single atomic increment, then the slot by setting
+   the lowest bit of its sequence number, which they replace with twice the
+   index plus two once the span is written. A writer finding the slot claimed
+   by another which lapped the ring drops its span. Writers are counted while
+   they check that tracing is still enabled and write, so that the ring is
+   only reallocated or read once tracing is stopped and none is left. Threads
+   are numbered in the order they first record a span. */
+struct ml_trace_span
+{
+    uint64_t sequence;
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+    unsigned int thread;
+};
+
+static struct ml_trace_span* trace_spans = NULL;
+static uint64_t trace_capacity = 0;
+static uint64_t trace_next = 0;
+static uint64_t trace_origin = 0;
+
+#if defined(__GNUC__) && !defined(ML_NO_PROFILE)
+# define ML_PROFILING
+#endif
+
+#ifdef ML_PROFILING
+static unsigned int trace_writers = 0;
+static unsigned int trace_threads = 0;
+static ML_THREAD_LOCAL unsigned int trace_thread = 0;
+
+/* The entry of the innermost callback stub being profiled, which the
+   allocations of the OCaml callbacks it dispatches are charged to. */
+static ML_THREAD_LOCAL struct ml_profile_entry* profile_callback_entry = NULL;
+
+/* Gc.minor_words, which does not allocate. */
+CAMLextern double caml_gc_minor_words_unboxed(void);
+
+static uint64_t profile_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void start_profile(
+    struct ml_profile_scope* scope, struct ml_profile_entry* entry, int kind)
+{
+    const int active = instrumentation
+        & (kind & ScopeTraced ? InstrumentProfile | InstrumentTrace
+           : InstrumentProfile);
+
+    if (active == 0)
+        return;
+    if (active & InstrumentProfile)
+    {
+        if (!__atomic_exchange_n(&entry->registered, 1, __ATOMIC_ACQ_REL))
+        {
+            entry->next = __atomic_load_n(&profile_entries, __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(
+                       &profile_entries, &entry->next, entry, 1,
+                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                ;
+        }
+        __atomic_fetch_add(&entry->calls, 1, __ATOMIC_RELAXED);
+        if (kind & ScopeCallback)
+        {
+            scope->previous_callback = profile_callback_entry;
+            profile_callback_entry = entry;
+        }
+    }
+    scope->entry = entry;
+    scope->active = active;
+    scope->start = profile_clock();
+}
+
+static void record_span(const char* name, uint64_t start, uint64_t duration)
+{
+    __atomic_fetch_add(&trace_writers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&instrumentation, __ATOMIC_SEQ_CST) & InstrumentTrace)
+    {
+        const uint64_t index =
+            __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+        struct ml_trace_span* span = &trace_spans[index % trace_capacity];
+        uint64_t sequence = __atomic_load_n(&span->sequence, __ATOMIC_RELAXED);
+
+        if (trace_thread == 0)
+            trace_thread =
+                __atomic_add_fetch(&trace_threads, 1, __ATOMIC_RELAXED);
+        if (!(sequence & 1)
+            && __atomic_compare_exchange_n(
+                &span->sequence, &sequence, 2 * index + 1, 0,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            span->name = name;
+            span->start = start;
+            span->duration = duration;
+            span->thread = trace_thread;
+            __atomic_store_n(&span->sequence, 2 * index + 2, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_fetch_sub(&trace_writers, 1, __ATOMIC_RELEASE);
+}
+
+/* Must be called once tracing is disabled. */
+static void wait_for_trace_writers(void)
+{
+    while (__atomic_load_n(&trace_writers, __ATOMIC_ACQUIRE) != 0)
+    {
+#ifdef ML_X86_SIMD
+        _mm_pause();
+#endif
+    }
+}
+
+static void finish_profile(struct ml_profile_scope* scope)
+{
+    const uint64_t elapsed = profile_clock() - scope->start;
+
+    if (scope->active & InstrumentProfile)
+    {
+        unsigned int bucket = 0;
+
+        for (uint64_t ns = elapsed >> 1;
+             ns != 0 && bucket < ML_PROFILE_BUCKETS - 1; ns >>= 1)
+            ++bucket;
+        __atomic_fetch_add(&scope->entry->total_ns, elapsed, __ATOMIC_RELAXED);
+        __atomic_fetch_add(
+            &scope->entry->histogram[bucket], 1, __ATOMIC_RELAXED);
+        if (profile_callback_entry == scope->entry)
+            profile_callback_entry = scope->previous_callback;
+    }
+    /* Tracing may have been stopped since the scope started. */
+    if (scope->active & InstrumentTrace)
+        record_span(scope->entry->name, scope->start, elapsed);
+}
+
+static inline struct ml_profile_scope begin_profile(
+    struct ml_profile_entry* entry, int kind)
+{
+    struct ml_profile_scope scope = {NULL, NULL, 0, 0};
+
+    if (__builtin_expect(instrumentation != 0, 0))
+        start_profile(&scope, entry, kind);
+    return scope;
+}
+
+static inline void end_profile(struct ml_profile_scope* scope)
+{
+    if (__builtin_expect(scope->entry != NULL, 0))
+        finish_profile(scope);
+}
+
+#define ML_PROFILE_SCOPE(kind)                                          \
+    static struct ml_profile_entry ml_profile_entry = {.name = __func__}; \
+    struct ml_profile_scope ml_profile_scope                            \
+        __attribute__((cleanup(end_profile)))                           \
+        = begin_profile(&ml_profile_entry, kind)
+
+/* Must be called with the runtime held. Returns a negative count when
+   allocations are not being measured. */
+static inline double begin_allocation_count(void)
+{
+    if (__builtin_expect(instrumentation & InstrumentProfile, 0)
+        && profile_callback_entry != NULL)
+        return caml_gc_minor_words_unboxed();
+    return -1.0;
+}
+
+static inline void end_allocation_count(double start)
+{
+    if (start >= 0.0 && profile_callback_entry != NULL)
+        profile_callback_entry->minor_words +=
+            caml_gc_minor_words_unboxed() - start;
+}
+
+/* The cleanup attribute does not run when a callback raises an exception,
+   which leaves the entry of its stub behind. No callback stub is running when
+   events start being processed. */
+static inline void reset_profile_callback(void)
+{
+    profile_callback_entry = NULL;
+}
+#else
+# define ML_PROFILE_SCOPE(kind) ((void)0)
+
+static inline double begin_allocation_count(void)
+{
+    return -1.0;
+}
+
+static inline void end_allocation_count(double start)
+{
+}
+
+static inline void reset_profile_callback(void)
+{
+}
+#endif
+
+#define ML_PROFILE() ML_PROFILE_SCOPE(0)
+#define ML_PROFILE_TRACED() ML_PROFILE_SCOPE(ScopeTraced)
+#define ML_PROFILE_CALLBACK() ML_PROFILE_SCOPE(ScopeCallback | ScopeTraced)
+
+/* The monitor callback stub is installed for as long as the library is
+   initialized, so that the monitor topology cache is invalidated on every
+   hotplug event. The OCaml closure is a global root registered once by
+   init_stub. */
+static value monitor_closure = Val_unit;
+static unsigned int monitor_generation = 1;
+
+static void cancel_gamma_transition(GLFWmonitor* monitor);
+
+void monitor_callback_stub(GLFWmonitor* monitor, int event)
+{
+    ML_PROFILE_CALLBACK();
+    ++monitor_generation;
+    if (event == GLFW_DISCONNECTED)
+        cancel_gamma_transition(monitor);
+    acquire_runtime();
+    if (monitor_closure != Val_unit)
     {
-        value error_tag_dup = error_tag;
-        value error_arg_dup = error_arg;
+        const double minor_words = begin_allocation_count();
 
-        error_tag = Val_unit;
-        error_arg = Val_unit;
-        caml_raise_with_arg(error_tag_dup, error_arg_dup);
+        caml_callback2(monitor_closure, Val_cptr(monitor),
+                       Val_int(event - GLFW_CONNECTED));
+        end_allocation_count(minor_words);
     }
 }
 
+/* Array of monitor_info records, valid as long as monitor_topology_generation
+   matches monitor_generation. When it is rebuilt, the name strings of the
+   previous array are reused for monitors with the same names. Monitors are
+   not matched by handle, as a new monitor may be allocated at the address of
+   a disconnected one. */
+static value monitor_topology = Val_unit;
+static unsigned int monitor_topology_generation = 0;
+
 CAMLprim value init_stub(CAMLvoid)
 {
+    static const char* const error_names[] = {
+        "GLFW.NotInitialized", "GLFW.NoCurrentContext", "GLFW.InvalidEnum",
+        "GLFW.InvalidValue", "GLFW.OutOfMemory", "GLFW.ApiUnavailable",
+        "GLFW.VersionUnavailable", "GLFW.PlatformError",
+        "GLFW.FormatUnavailable", "GLFW.NoWindowContext"
+    };
+
+    for (unsigned int i = 0; i < sizeof(error_tags) / sizeof(*error_tags); ++i)
+        error_tags[i] = caml_named_value(error_names[i]);
+    assert(sizeof(ml_to_glfw_key) / sizeof(*ml_to_glfw_key)
+           <= ML_KEY_BITMAP_SIZE * 8);
+    caml_register_generational_global_root(&monitor_closure);
     glfwSetErrorCallback(error_callback);
+#ifdef ML_PROFILING
+    const char* profile = getenv("GLFW_OCAML_PROFILE");
+
+    if (profile != NULL && *profile != '\0' && strcmp(profile, "0") != 0)
+        instrumentation |= InstrumentProfile;
+#endif
     return Val_unit;
 }
 
+/* The value of the visible hint, which GLFW offers no way to query, for
+   createOffscreenWindow to restore. GLFW resets the hints on initialization
+   too. */
+static int visible_hint = GLFW_TRUE;
+
 CAMLprim value caml_glfwInit(CAMLvoid)
 {
+    ML_PROFILE();
     glfwInit();
     raise_if_error();
+    visible_hint = GLFW_TRUE;
+    glfwSetMonitorCallback(monitor_callback_stub);
+    ++monitor_generation;
     return Val_unit;
 }
 
 CAMLprim value caml_glfwTerminate(CAMLvoid)
 {
+    ML_PROFILE();
+    cancel_gamma_transition(NULL);
+    stop_cursor_animations();
+    stop_captures();
+    invalidate_cursor_cache();
+    unload_proc_tables();
+    forget_frame_stats();
     glfwTerminate();
+    ++monitor_generation;
+    if (monitor_topology != Val_unit)
+        caml_modify_generational_global_root(&monitor_topology, Atom(0));
     raise_if_error();
     return Val_unit;
 }
 
 CAMLprim value caml_glfwInitHint(value hint, value ml_val)
 {
+    ML_PROFILE();
     const int offset = Int_val(hint);
     /* All updateable attributes are booleans at the moment. */
     const int glfw_val = Bool_val(ml_val);
@@ -338,6 +1014,7 @@ CAMLprim value caml_glfwInitHint(value hint, value ml_val)
 
 CAMLprim value caml_glfwGetVersion(CAMLvoid)
 {
+    ML_PROFILE();
     int major, minor, rev;
     value ret;
 
@@ -351,11 +1028,13 @@ CAMLprim value caml_glfwGetVersion(CAMLvoid)
 
 CAMLprim value caml_glfwGetVersionString(CAMLvoid)
 {
+    ML_PROFILE();
     return caml_copy_string(glfwGetVersionString());
 }
 
 CAMLprim value caml_glfwGetMonitors(CAMLvoid)
 {
+    ML_PROFILE();
     int monitor_count;
     GLFWmonitor** monitors = glfwGetMonitors(&monitor_count);
 
@@ -365,6 +1044,7 @@ CAMLprim value caml_glfwGetMonitors(CAMLvoid)
 
 CAMLprim value caml_glfwGetPrimaryMonitor(CAMLvoid)
 {
+    ML_PROFILE();
     GLFWmonitor* ret = glfwGetPrimaryMonitor();
     raise_if_error();
     return Val_cptr(ret);
@@ -372,6 +1052,7 @@ CAMLprim value caml_glfwGetPrimaryMonitor(CAMLvoid)
 
 CAMLprim value caml_glfwGetMonitorPos(value monitor)
 {
+    ML_PROFILE();
     int xpos, ypos;
     value ret;
 
@@ -385,6 +1066,7 @@ CAMLprim value caml_glfwGetMonitorPos(value monitor)
 
 CAMLprim value caml_glfwGetMonitorWorkarea(value monitor)
 {
+    ML_PROFILE();
     int xpos, ypos, width, height;
     value ret;
 
@@ -401,6 +1083,7 @@ CAMLprim value caml_glfwGetMonitorWorkarea(value monitor)
 
 CAMLprim value caml_glfwGetMonitorPhysicalSize(value monitor)
 {
+    ML_PROFILE();
     int width, height;
     value ret;
 
@@ -415,6 +1098,7 @@ CAMLprim value caml_glfwGetMonitorPhysicalSize(value monitor)
 
 CAMLprim value caml_glfwGetMonitorContentScale(value monitor)
 {
+    ML_PROFILE();
     CAMLparam0();
     CAMLlocal3(ml_xscale, ml_yscale, ret);
     float xscale, yscale;
@@ -432,23 +1116,123 @@ CAMLprim value caml_glfwGetMonitorContentScale(value monitor)
 
 CAMLprim value caml_glfwGetMonitorName(value monitor)
 {
+    ML_PROFILE();
     const char* ret = glfwGetMonitorName(Cptr_val(GLFWmonitor*, monitor));
     raise_if_error();
     return caml_copy_string(ret);
 }
 
-static value monitor_closure = Val_unit;
+CAMLprim value caml_glfwSetMonitorCallback(value new_closure)
+{
+    ML_PROFILE();
+    CAMLparam1(new_closure);
+    CAMLlocal1(previous_closure);
 
-void monitor_callback_stub(GLFWmonitor* monitor, int event)
+    if (monitor_closure == Val_unit)
+        previous_closure = Val_none;
+    else
+        previous_closure = caml_alloc_some(monitor_closure);
+    caml_modify_generational_global_root(
+        &monitor_closure,
+        Is_none(new_closure) ? Val_unit : Some_val(new_closure));
+    CAMLreturn(previous_closure);
+}
+
+static value find_monitor_name(const char* name)
 {
-    caml_callback2(
-        monitor_closure, Val_cptr(monitor), Val_int(event - GLFW_CONNECTED));
+    if (monitor_topology == Val_unit)
+        return Val_unit;
+    for (mlsize_t i = 0; i < Wosize_val(monitor_topology); ++i)
+    {
+        value ml_name = Field(Field(monitor_topology, i), 1);
+
+        if (strcmp(String_val(ml_name), name) == 0)
+            return ml_name;
+    }
+    return Val_unit;
+}
+
+static value caml_copy_monitor_info(GLFWmonitor* monitor)
+{
+    CAMLparam0();
+    CAMLlocal4(ret, name, modes, vm);
+    int xpos, ypos, wa_xpos, wa_ypos, wa_width, wa_height, width_mm, height_mm;
+    float xscale, yscale;
+    int mode_count;
+    const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+    const GLFWvidmode* mode_list = glfwGetVideoModes(monitor, &mode_count);
+
+    glfwGetMonitorPos(monitor, &xpos, &ypos);
+    glfwGetMonitorWorkarea(monitor, &wa_xpos, &wa_ypos, &wa_width, &wa_height);
+    glfwGetMonitorPhysicalSize(monitor, &width_mm, &height_mm);
+    glfwGetMonitorContentScale(monitor, &xscale, &yscale);
+    raise_if_error();
+    name = find_monitor_name(glfwGetMonitorName(monitor));
+    if (name == Val_unit)
+        name = caml_copy_string(glfwGetMonitorName(monitor));
+    modes = mode_count == 0 ? Atom(0) : caml_alloc(mode_count, 0);
+    for (int i = 0; i < mode_count; ++i)
+    {
+        vm = caml_copy_vidmode(mode_list + i);
+        Store_field(modes, i, vm);
+    }
+    vm = caml_copy_vidmode(mode);
+    ret = caml_alloc(14, 0);
+    Store_field(ret, 0, Val_cptr(monitor));
+    Store_field(ret, 1, name);
+    Store_field(ret, 2, Val_int(xpos));
+    Store_field(ret, 3, Val_int(ypos));
+    Store_field(ret, 4, Val_int(wa_xpos));
+    Store_field(ret, 5, Val_int(wa_ypos));
+    Store_field(ret, 6, Val_int(wa_width));
+    Store_field(ret, 7, Val_int(wa_height));
+    Store_field(ret, 8, Val_int(width_mm));
+    Store_field(ret, 9, Val_int(height_mm));
+    Store_field(ret, 10, caml_copy_double(xscale));
+    Store_field(ret, 11, caml_copy_double(yscale));
+    Store_field(ret, 12, vm);
+    Store_field(ret, 13, modes);
+    CAMLreturn(ret);
 }
 
-CAML_SETTER_STUB(glfwSetMonitorCallback, monitor)
+CAMLprim value caml_getMonitorTopology(CAMLvoid)
+{
+    CAMLparam0();
+    CAMLlocal2(ret, info);
+    int count;
+    GLFWmonitor** monitors;
+
+    if (monitor_topology_generation == monitor_generation)
+        CAMLreturn(monitor_topology);
+    monitors = glfwGetMonitors(&count);
+    raise_if_error();
+    ret = count == 0 ? Atom(0) : caml_alloc(count, 0);
+    for (int i = 0; i < count; ++i)
+    {
+        info = caml_copy_monitor_info(monitors[i]);
+        Store_field(ret, i, info);
+    }
+    if (monitor_topology == Val_unit)
+        caml_register_generational_global_root(&monitor_topology);
+    caml_modify_generational_global_root(&monitor_topology, ret);
+    monitor_topology_generation = monitor_generation;
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_getMonitorGeneration(CAMLvoid)
+{
+    return Val_int(monitor_generation);
+}
+
+CAMLprim value caml_invalidateMonitorTopology(CAMLvoid)
+{
+    ++monitor_generation;
+    return Val_unit;
+}
 
 CAMLprim value caml_glfwGetVideoModes(value monitor)
 {
+    ML_PROFILE();
     CAMLparam0();
     CAMLlocal2(ret, vm);
     int videomode_count;
@@ -470,27 +1254,97 @@ CAMLprim value caml_glfwGetVideoModes(value monitor)
 
 CAMLprim value caml_glfwGetVideoMode(value monitor)
 {
+    ML_PROFILE();
     const GLFWvidmode* ret = glfwGetVideoMode(Cptr_val(GLFWmonitor*, monitor));
     raise_if_error();
     return caml_copy_vidmode(ret);
 }
 
-CAMLprim value caml_glfwSetGamma(value monitor, value gamma)
+/* GLFWvidmode holds six ints, so an array of video modes can be copied as
+   is into a two dimensional int32 Bigarray with one row per mode. */
+CAMLprim value caml_getVideoModesBigarray(value monitor)
 {
-    glfwSetGamma(Cptr_val(GLFWmonitor*, monitor), Double_val(gamma));
+    int count;
+    const GLFWvidmode* modes =
+        glfwGetVideoModes(Cptr_val(GLFWmonitor*, monitor), &count);
+    value ret;
+
     raise_if_error();
-    return Val_unit;
+    assert(sizeof(GLFWvidmode) == 6 * sizeof(int32_t));
+    ret = caml_ba_alloc_dims(CAML_BA_INT32 | CAML_BA_C_LAYOUT, 2, NULL,
+                             (intnat)count, (intnat)6);
+    memcpy(Caml_ba_data_val(ret), modes, count * sizeof(GLFWvidmode));
+    return ret;
 }
 
-CAMLprim value caml_glfwGetGammaRamp(value monitor)
+/* Same order as the constructors of the video_mode_priority type. */
+enum ml_video_mode_priority
 {
-    CAMLparam0();
-    CAMLlocal1(ret);
-    const GLFWgammaramp* gamma_ramp =
-        glfwGetGammaRamp(Cptr_val(GLFWmonitor*, monitor));
-    raise_if_error();
-    const int flags = CAML_BA_UINT16 | CAML_BA_C_LAYOUT;
-    intnat size = gamma_ramp->size;
+    ResolutionFirst,
+    RefreshRateFirst
+};
+
+CAMLprim value caml_findVideoMode(
+    value monitor, value width, value height, value refresh_rate,
+    value priority)
+{
+    int count;
+    const GLFWvidmode* modes =
+        glfwGetVideoModes(Cptr_val(GLFWmonitor*, monitor), &count);
+    const GLFWvidmode* best = NULL;
+    unsigned int best_primary = UINT_MAX, best_secondary = UINT_MAX;
+    int best_bits = 0;
+
+    raise_if_error();
+    for (int i = 0; i < count; ++i)
+    {
+        const GLFWvidmode* mode = modes + i;
+        const unsigned int size_diff =
+            abs(mode->width - Int_val(width))
+            + abs(mode->height - Int_val(height));
+        const unsigned int rate_diff = Is_none(refresh_rate)
+            ? 0 : abs(mode->refreshRate - Int_val(Some_val(refresh_rate)));
+        const int resolution_first = Int_val(priority) == ResolutionFirst;
+        const unsigned int primary = resolution_first ? size_diff : rate_diff;
+        const unsigned int secondary = resolution_first ? rate_diff : size_diff;
+        const int bits = mode->redBits + mode->greenBits + mode->blueBits;
+
+        /* Ties are broken by preferring deeper, then faster modes. */
+        if (best == NULL
+            || primary < best_primary
+            || (primary == best_primary && secondary < best_secondary)
+            || (primary == best_primary && secondary == best_secondary
+                && (bits > best_bits
+                    || (bits == best_bits
+                        && mode->refreshRate > best->refreshRate))))
+        {
+            best = mode;
+            best_primary = primary;
+            best_secondary = secondary;
+            best_bits = bits;
+        }
+    }
+    return best == NULL ? Val_none : caml_alloc_some(caml_copy_vidmode(best));
+}
+
+CAMLprim value caml_glfwSetGamma(value monitor, value gamma)
+{
+    ML_PROFILE();
+    glfwSetGamma(Cptr_val(GLFWmonitor*, monitor), Double_val(gamma));
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwGetGammaRamp(value monitor)
+{
+    ML_PROFILE();
+    CAMLparam0();
+    CAMLlocal1(ret);
+    const GLFWgammaramp* gamma_ramp =
+        glfwGetGammaRamp(Cptr_val(GLFWmonitor*, monitor));
+    raise_if_error();
+    const int flags = CAML_BA_UINT16 | CAML_BA_C_LAYOUT;
+    intnat size = gamma_ramp->size;
     const unsigned int byte_size = size * sizeof(*gamma_ramp->red);
 
     ret = caml_alloc_small(3, 0);
@@ -508,6 +1362,7 @@ CAMLprim value caml_glfwGetGammaRamp(value monitor)
 
 CAMLprim value caml_glfwSetGammaRamp(value monitor, value ml_gamma_ramp)
 {
+    ML_PROFILE();
     GLFWgammaramp gamma_ramp;
 
     gamma_ramp.size =
@@ -520,15 +1375,174 @@ CAMLprim value caml_glfwSetGammaRamp(value monitor, value ml_gamma_ramp)
     return Val_unit;
 }
 
+CAMLprim value caml_getGammaRampInto(value monitor, value ml_gamma_ramp)
+{
+    const GLFWgammaramp* gamma_ramp =
+        glfwGetGammaRamp(Cptr_val(GLFWmonitor*, monitor));
+    raise_if_error();
+    const unsigned int byte_size = gamma_ramp->size * sizeof(*gamma_ramp->red);
+
+    if (caml_ba_num_elts(Caml_ba_array_val(Field(ml_gamma_ramp, 0)))
+        != gamma_ramp->size)
+        caml_invalid_argument(
+            "getGammaRampInto: gamma ramp size does not match the monitor's.");
+    memcpy(Caml_ba_data_val(Field(ml_gamma_ramp, 0)), gamma_ramp->red,
+           byte_size);
+    memcpy(Caml_ba_data_val(Field(ml_gamma_ramp, 1)), gamma_ramp->green,
+           byte_size);
+    memcpy(Caml_ba_data_val(Field(ml_gamma_ramp, 2)), gamma_ramp->blue,
+           byte_size);
+    return Val_unit;
+}
+
+/* Gamma ramp transitions are advanced and applied in C each time events
+   are processed. The start, target and current ramps of a transition are
+   stored after the structure, each as its red, green and blue channels
+   laid out contiguously. */
+struct ml_gamma_transition
+{
+    GLFWmonitor* monitor;
+    double start_time;
+    double duration;
+    unsigned int size;
+    unsigned int weight;
+    struct ml_gamma_transition* next;
+    unsigned short ramps[];
+};
+
+static struct ml_gamma_transition* gamma_transitions = NULL;
+
+/* Fixed-point interpolation with a 15 bit weight, written so that the
+   compiler can vectorise it. */
+#define ML_GAMMA_WEIGHT_ONE (1u << 15)
+
+static void lerp_gamma_ramps(
+    unsigned short* restrict dst, const unsigned short* restrict start,
+    const unsigned short* restrict target, unsigned int count,
+    unsigned int weight)
+{
+    const unsigned int start_weight = ML_GAMMA_WEIGHT_ONE - weight;
+
+    for (unsigned int i = 0; i < count; ++i)
+        dst[i] = (start[i] * start_weight + target[i] * weight) >> 15;
+}
+
+static void apply_gamma_ramp(
+    GLFWmonitor* monitor, unsigned short* ramp, unsigned int size)
+{
+    GLFWgammaramp gamma_ramp;
+
+    gamma_ramp.size = size;
+    gamma_ramp.red = ramp;
+    gamma_ramp.green = ramp + size;
+    gamma_ramp.blue = ramp + 2 * size;
+    glfwSetGammaRamp(monitor, &gamma_ramp);
+}
+
+/* Cancels all transitions if monitor is NULL. */
+static void cancel_gamma_transition(GLFWmonitor* monitor)
+{
+    struct ml_gamma_transition** iter = &gamma_transitions;
+
+    while (*iter != NULL)
+        if (monitor == NULL || (*iter)->monitor == monitor)
+        {
+            struct ml_gamma_transition* transition = *iter;
+            *iter = transition->next;
+            free(transition);
+        }
+        else
+            iter = &(*iter)->next;
+}
+
+static void advance_gamma_transitions(void)
+{
+    struct ml_gamma_transition** iter = &gamma_transitions;
+    const double now = glfwGetTime();
+
+    while (*iter != NULL)
+    {
+        struct ml_gamma_transition* transition = *iter;
+        const unsigned int count = 3 * transition->size;
+        const double progress = transition->duration > 0.0
+            ? (now - transition->start_time) / transition->duration : 1.0;
+        const unsigned int weight = progress >= 1.0 ? ML_GAMMA_WEIGHT_ONE
+            : progress <= 0.0 ? 0 : progress * ML_GAMMA_WEIGHT_ONE;
+
+        if (weight != transition->weight)
+        {
+            unsigned short* current = transition->ramps + 2 * count;
+
+            lerp_gamma_ramps(current, transition->ramps,
+                             transition->ramps + count, count, weight);
+            apply_gamma_ramp(transition->monitor, current, transition->size);
+            transition->weight = weight;
+        }
+        if (weight == ML_GAMMA_WEIGHT_ONE)
+        {
+            *iter = transition->next;
+            free(transition);
+        }
+        else
+            iter = &transition->next;
+    }
+}
+
+CAMLprim value caml_startGammaTransition(
+    value ml_monitor, value start, value target, value duration)
+{
+    GLFWmonitor* monitor = Cptr_val(GLFWmonitor*, ml_monitor);
+    const unsigned int size =
+        caml_ba_num_elts(Caml_ba_array_val(Field(start, 0)));
+    const unsigned int byte_size = size * sizeof(unsigned short);
+    struct ml_gamma_transition* transition;
+
+    if (caml_ba_num_elts(Caml_ba_array_val(Field(target, 0))) != size)
+        caml_invalid_argument(
+            "startGammaTransition: gamma ramps of different sizes.");
+    cancel_gamma_transition(monitor);
+    transition = malloc(sizeof(*transition) + 3 * 3 * byte_size);
+    if (transition == NULL)
+        caml_raise_out_of_memory();
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        memcpy(transition->ramps + i * size,
+               Caml_ba_data_val(Field(start, i)), byte_size);
+        memcpy(transition->ramps + (3 + i) * size,
+               Caml_ba_data_val(Field(target, i)), byte_size);
+    }
+    transition->monitor = monitor;
+    transition->start_time = glfwGetTime();
+    transition->duration = Double_val(duration);
+    transition->size = size;
+    transition->weight = UINT_MAX;
+    transition->next = gamma_transitions;
+    gamma_transitions = transition;
+    advance_gamma_transitions();
+    if (error_code != GLFW_NO_ERROR)
+        cancel_gamma_transition(monitor);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_cancelGammaTransition(value monitor)
+{
+    cancel_gamma_transition(Cptr_val(GLFWmonitor*, monitor));
+    return Val_unit;
+}
+
 CAMLprim value caml_glfwDefaultWindowHints(CAMLvoid)
 {
+    ML_PROFILE();
     glfwDefaultWindowHints();
     raise_if_error();
+    visible_hint = GLFW_TRUE;
     return Val_unit;
 }
 
 CAMLprim value caml_glfwWindowHint(value hint, value ml_val)
 {
+    ML_PROFILE();
     const int offset = Int_val(hint);
     int glfw_val;
 
@@ -595,28 +1609,42 @@ CAMLprim value caml_glfwWindowHint(value hint, value ml_val)
     }
     glfwWindowHint(ml_window_attrib[offset].glfw_window_attrib, glfw_val);
     raise_if_error();
+    if (ml_window_attrib[offset].glfw_window_attrib == GLFW_VISIBLE)
+        visible_hint = glfw_val;
     return Val_unit;
 }
 
-CAMLprim value caml_glfwCreateWindow(
-    value width, value height, value title, value mntor, value share, CAMLvoid)
+/* Attaches our data to a newly created window, raising the error that
+   prevented its creation if any. */
+static value wrap_window(GLFWwindow* window)
 {
-    GLFWwindow* window = glfwCreateWindow(
-        Int_val(width), Int_val(height), String_val(title),
-        Is_none(mntor) ? NULL : Cptr_val(GLFWmonitor*, Some_val(mntor)),
-        Is_none(share) ? NULL : Cptr_val(GLFWwindow*, Some_val(share)));
     raise_if_error();
-    void* user_pointer = malloc(sizeof(value));
+    struct ml_window_data* user_pointer = malloc(sizeof(*user_pointer));
     value callbacks = caml_alloc_small(ML_WINDOW_CALLBACKS_WOSIZE, 0);
 
     for (unsigned int i = 0; i < ML_WINDOW_CALLBACKS_WOSIZE; ++i)
         Field(callbacks, i) = Val_unit;
-    *(value*)user_pointer = callbacks;
-    caml_register_generational_global_root(user_pointer);
+    memset(user_pointer, 0, sizeof(*user_pointer));
+    user_pointer->callbacks = callbacks;
+    user_pointer->window = window;
+    for (unsigned int i = 0; i < ML_CONTEXT_SIGNATURE_SIZE; ++i)
+        user_pointer->context_signature[i] =
+            glfwGetWindowAttrib(window, context_signature_attribs[i]);
+    caml_register_generational_global_root(&user_pointer->callbacks);
     glfwSetWindowUserPointer(window, user_pointer);
     return Val_cptr(window);
 }
 
+CAMLprim value caml_glfwCreateWindow(
+    value width, value height, value title, value mntor, value share, CAMLvoid)
+{
+    ML_PROFILE();
+    return wrap_window(glfwCreateWindow(
+        Int_val(width), Int_val(height), String_val(title),
+        Is_none(mntor) ? NULL : Cptr_val(GLFWmonitor*, Some_val(mntor)),
+        Is_none(share) ? NULL : Cptr_val(GLFWwindow*, Some_val(share))));
+}
+
 CAMLprim value caml_glfwCreateWindow_byte(value* val_array, int val_count)
 {
     (void)val_count;
@@ -624,14 +1652,99 @@ CAMLprim value caml_glfwCreateWindow_byte(value* val_array, int val_count)
                                  val_array[3], val_array[4], Val_unit);
 }
 
+/* The visible hint is set back to the value it had before the call. */
+CAMLprim value caml_createOffscreenWindow(
+    value width, value height, value share, CAMLvoid)
+{
+    GLFWwindow* window;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(
+        Int_val(width), Int_val(height), "", NULL,
+        Is_none(share) ? NULL : Cptr_val(GLFWwindow*, Some_val(share)));
+    glfwWindowHint(GLFW_VISIBLE, visible_hint);
+    return wrap_window(window);
+}
+
+/* Only declared by glfw3native.h, which would require the OSMesa header. */
+#ifndef GLFW_EXPOSE_NATIVE_OSMESA
+GLFWAPI int glfwGetOSMesaColorBuffer(
+    GLFWwindow* window, int* width, int* height, int* format, void** buffer);
+GLFWAPI int glfwGetOSMesaDepthBuffer(
+    GLFWwindow* window, int* width, int* height, int* bytes_per_value,
+    void** buffer);
+#endif
+
+/* Pixel sizes of the OSMesa color formats. GLFW itself always creates
+   OSMESA_RGBA contexts. */
+static int osmesa_pixel_size(int format)
+{
+    switch (format)
+    {
+    case 0x1907: /* OSMESA_RGB */
+    case 0x4: /* OSMESA_BGR */
+        return 3;
+    case 0x5: /* OSMESA_RGB_565 */
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+/* The Bigarrays returned by the following functions alias the buffers of
+   the OSMesa context, which remain valid until the window is resized or
+   destroyed. */
+CAMLprim value caml_glfwGetOSMesaColorBuffer(value window)
+{
+    ML_PROFILE();
+    int width = 0, height = 0, format = 0;
+    void* buffer = NULL;
+
+    glfwGetOSMesaColorBuffer(
+        Cptr_val(GLFWwindow*, window), &width, &height, &format, &buffer);
+    raise_if_error();
+    return caml_ba_alloc_dims(
+        CAML_BA_UINT8 | CAML_BA_C_LAYOUT | CAML_BA_EXTERNAL, 3, buffer,
+        (intnat)height, (intnat)width, (intnat)osmesa_pixel_size(format));
+}
+
+CAMLprim value caml_glfwGetOSMesaDepthBuffer(value window)
+{
+    ML_PROFILE();
+    CAMLparam1(window);
+    CAMLlocal2(ret, depth);
+    int width = 0, height = 0, bytes_per_value = 0;
+    void* buffer = NULL;
+
+    glfwGetOSMesaDepthBuffer(Cptr_val(GLFWwindow*, window), &width, &height,
+                             &bytes_per_value, &buffer);
+    raise_if_error();
+    depth = caml_ba_alloc_dims(
+        (bytes_per_value == 2 ? CAML_BA_UINT16 : CAML_BA_INT32)
+        | CAML_BA_C_LAYOUT | CAML_BA_EXTERNAL, 2, buffer,
+        (intnat)height, (intnat)width);
+    ret = caml_alloc_small(1, bytes_per_value == 2 ? 0 : 1);
+    Field(ret, 0) = depth;
+    CAMLreturn(ret);
+}
+
 CAMLprim value caml_glfwDestroyWindow(value ml_window)
 {
+    ML_PROFILE();
     GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
     void* user_pointer = glfwGetWindowUserPointer(window);
+    struct ml_capture* capture;
 
     raise_if_error();
     caml_remove_generational_global_root(user_pointer);
+    remove_pending_window(user_pointer);
+    stop_cursor_animation(user_pointer);
+    capture = detach_capture(user_pointer);
+    if (capture != NULL)
+        free_capture(capture);
+    free_frame_stats(user_pointer);
     free(user_pointer);
+    purge_window_events(window);
     glfwDestroyWindow(window);
     raise_if_error();
     return Val_unit;
@@ -639,6 +1752,7 @@ CAMLprim value caml_glfwDestroyWindow(value ml_window)
 
 CAMLprim value caml_glfwWindowShouldClose(value window)
 {
+    ML_PROFILE();
     int ret = glfwWindowShouldClose(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_bool(ret);
@@ -646,6 +1760,7 @@ CAMLprim value caml_glfwWindowShouldClose(value window)
 
 CAMLprim value caml_glfwSetWindowShouldClose(value window, value val)
 {
+    ML_PROFILE();
     glfwSetWindowShouldClose(Cptr_val(GLFWwindow*, window), Bool_val(val));
     raise_if_error();
     return Val_unit;
@@ -653,40 +1768,267 @@ CAMLprim value caml_glfwSetWindowShouldClose(value window, value val)
 
 CAMLprim value caml_glfwSetWindowTitle(value window, value title)
 {
+    ML_PROFILE();
     glfwSetWindowTitle(Cptr_val(GLFWwindow*, window), String_val(title));
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwSetWindowIcon(value window, value images)
+/* Image.t and BigarrayImage.t share the same layout, only the type of
+   their pixels field differs. In both cases GLFW reads the pixels in
+   place. */
+static void image_of_ml_image(GLFWimage* image, value ml_image, int bigarray)
+{
+    image->width = Int_val(Field(ml_image, 0));
+    image->height = Int_val(Field(ml_image, 1));
+    image->pixels = bigarray
+        ? Caml_ba_data_val(Field(ml_image, 2))
+        : Bytes_val(Field(ml_image, 2));
+}
+
+/* Most applications set between one and four icons, for which no heap
+   allocation is needed. */
+#define ML_ICON_STACK_COUNT 4
+
+static void set_window_icon(value window, value images, int bigarray)
 {
     unsigned int count = 0;
     value iter = images;
-    GLFWimage* glfw_images;
+    GLFWimage stack_images[ML_ICON_STACK_COUNT];
+    GLFWimage* glfw_images = stack_images;
 
     while (iter != Val_emptylist)
     {
         ++count;
         iter = Field(iter, 1);
     }
-    glfw_images = malloc(sizeof(*glfw_images) * count);
+    if (count > ML_ICON_STACK_COUNT)
+    {
+        glfw_images = malloc(sizeof(*glfw_images) * count);
+        if (glfw_images == NULL)
+            caml_raise_out_of_memory();
+    }
     iter = images;
     for (unsigned int i = 0; i < count; ++i)
     {
-        value ml_image = Field(iter, 0);
-        glfw_images[i].width = Int_val(Field(ml_image, 0));
-        glfw_images[i].height = Int_val(Field(ml_image, 1));
-        glfw_images[i].pixels = Bytes_val(Field(ml_image, 2));
+        image_of_ml_image(glfw_images + i, Field(iter, 0), bigarray);
         iter = Field(iter, 1);
     }
-    glfwSetWindowIcon(Cptr_val(GLFWwindow*, window), count, glfw_images);
-    free(glfw_images);
+    /* An empty list reverts to the default icon. */
+    glfwSetWindowIcon(Cptr_val(GLFWwindow*, window), count,
+                      count == 0 ? NULL : glfw_images);
+    if (glfw_images != stack_images)
+        free(glfw_images);
     raise_if_error();
+}
+
+CAMLprim value caml_glfwSetWindowIcon(value window, value images)
+{
+    ML_PROFILE();
+    set_window_icon(window, images, 0);
+    return Val_unit;
+}
+
+CAMLprim value caml_setWindowIconBigarray(value window, value images)
+{
+    set_window_icon(window, images, 1);
+    return Val_unit;
+}
+
+/* Pixel format conversions to the non-premultiplied RGBA8 format GLFW
+   expects, in the same order as the constructors of Image.pixel_format.
+   SSE2 is always available on x86-64; SSSE3 is detected at run time. */
+enum ml_pixel_format
+{
+    FormatRGBA,
+    FormatBGRA,
+    FormatPremultipliedRGBA,
+    FormatPremultipliedBGRA,
+    FormatRGB,
+    FormatBGR
+};
+
+static void swap_red_blue(
+    unsigned char* restrict dst, const unsigned char* restrict src,
+    size_t count)
+{
+    size_t i = 0;
+
+#if defined(ML_X86_SIMD) && defined(__SSE2__)
+    const __m128i green_alpha = _mm_set1_epi32(0xFF00FF00);
+    const __m128i low_byte = _mm_set1_epi32(0x000000FF);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        __m128i red_blue = _mm_or_si128(
+            _mm_and_si128(_mm_srli_epi32(v, 16), low_byte),
+            _mm_slli_epi32(_mm_and_si128(v, low_byte), 16));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i),
+                         _mm_or_si128(_mm_and_si128(v, green_alpha), red_blue));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        const unsigned char red = src[4 * i + 2];
+
+        dst[4 * i + 2] = src[4 * i];
+        dst[4 * i + 1] = src[4 * i + 1];
+        dst[4 * i + 3] = src[4 * i + 3];
+        dst[4 * i] = red;
+    }
+}
+
+#ifdef ML_X86_SIMD
+__attribute__((target("ssse3")))
+static size_t expand_rgb_ssse3(
+    unsigned char* restrict dst, const unsigned char* restrict src,
+    size_t count, int swap)
+{
+    const __m128i shuffle = swap
+        ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+        : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    size_t i = 0;
+
+    /* Each iteration reads 16 bytes but only uses 12 of them. */
+    for (; i + 6 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i),
+                         _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+    }
+    return i;
+}
+#endif
+
+static void expand_rgb(
+    unsigned char* restrict dst, const unsigned char* restrict src,
+    size_t count, int swap)
+{
+    size_t i = 0;
+
+#ifdef ML_X86_SIMD
+    if (__builtin_cpu_supports("ssse3"))
+        i = expand_rgb_ssse3(dst, src, count, swap);
+#endif
+    for (; i < count; ++i)
+    {
+        dst[4 * i] = src[3 * i + (swap ? 2 : 0)];
+        dst[4 * i + 1] = src[3 * i + 1];
+        dst[4 * i + 2] = src[3 * i + (swap ? 0 : 2)];
+        dst[4 * i + 3] = 255;
+    }
+}
+
+/* Divides by alpha through a 16.16 fixed-point reciprocal, computed once
+   per pixel. */
+static void unpremultiply(unsigned char* pixels, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned char* p = pixels + 4 * i;
+        const unsigned int reciprocal =
+            p[3] == 0 ? 0 : ((255u << 16) + p[3] / 2) / p[3];
+
+        for (unsigned int c = 0; c < 3; ++c)
+        {
+            const unsigned int v = (p[c] * reciprocal + 0x8000) >> 16;
+            p[c] = v > 255 ? 255 : v;
+        }
+    }
+}
+
+static void convert_pixels(
+    unsigned char* restrict dst, const unsigned char* restrict src,
+    size_t count, enum ml_pixel_format format)
+{
+    switch (format)
+    {
+    case FormatRGBA:
+    case FormatPremultipliedRGBA:
+        memcpy(dst, src, 4 * count);
+        break;
+    case FormatBGRA:
+    case FormatPremultipliedBGRA:
+        swap_red_blue(dst, src, count);
+        break;
+    case FormatRGB:
+        expand_rgb(dst, src, count, 0);
+        break;
+    case FormatBGR:
+        expand_rgb(dst, src, count, 1);
+    }
+    if (format == FormatPremultipliedRGBA || format == FormatPremultipliedBGRA)
+        unpremultiply(dst, count);
+}
+
+/* Box filter: each destination pixel averages the source pixels it covers,
+   weighting colors by alpha so that transparent pixels do not darken the
+   edges of the result. */
+static void scale_pixels(
+    unsigned char* restrict dst, unsigned int dst_width,
+    unsigned int dst_height, const unsigned char* restrict src,
+    unsigned int src_width, unsigned int src_height)
+{
+    for (unsigned int dy = 0; dy < dst_height; ++dy)
+    {
+        const unsigned int y0 = (unsigned long)dy * src_height / dst_height;
+        unsigned int y1 = (unsigned long)(dy + 1) * src_height / dst_height;
+
+        if (y1 <= y0)
+            y1 = y0 + 1;
+        for (unsigned int dx = 0; dx < dst_width; ++dx)
+        {
+            const unsigned int x0 = (unsigned long)dx * src_width / dst_width;
+            unsigned int x1 = (unsigned long)(dx + 1) * src_width / dst_width;
+            unsigned long sum[3] = {0, 0, 0}, alpha = 0, area;
+            unsigned char* p = dst + 4 * ((size_t)dy * dst_width + dx);
+
+            if (x1 <= x0)
+                x1 = x0 + 1;
+            area = (unsigned long)(x1 - x0) * (y1 - y0);
+            for (unsigned int y = y0; y < y1; ++y)
+            {
+                const unsigned char* row = src + 4 * (size_t)y * src_width;
+
+                for (unsigned int x = x0; x < x1; ++x)
+                {
+                    const unsigned char* q = row + 4 * x;
+
+                    sum[0] += q[0] * q[3];
+                    sum[1] += q[1] * q[3];
+                    sum[2] += q[2] * q[3];
+                    alpha += q[3];
+                }
+            }
+            for (unsigned int c = 0; c < 3; ++c)
+                p[c] = alpha == 0 ? 0 : (sum[c] + alpha / 2) / alpha;
+            p[3] = (alpha + area / 2) / area;
+        }
+    }
+}
+
+CAMLprim value caml_convertImagePixels(
+    value format, value src, value dst, value count)
+{
+    convert_pixels(Bytes_val(dst), Bytes_val(src), Long_val(count),
+                   Int_val(format));
+    return Val_unit;
+}
+
+CAMLprim value caml_scaleImagePixels(
+    value image, value dst, value width, value height)
+{
+    scale_pixels(Bytes_val(dst), Int_val(width), Int_val(height),
+                 Bytes_val(Field(image, 2)), Int_val(Field(image, 0)),
+                 Int_val(Field(image, 1)));
     return Val_unit;
 }
 
 CAMLprim value caml_glfwGetWindowPos(value window)
 {
+    ML_PROFILE();
     int xpos, ypos;
     value ret;
 
@@ -700,6 +2042,7 @@ CAMLprim value caml_glfwGetWindowPos(value window)
 
 CAMLprim value caml_glfwSetWindowPos(value window, value xpos, value ypos)
 {
+    ML_PROFILE();
     glfwSetWindowPos(
         Cptr_val(GLFWwindow*, window), Int_val(xpos), Int_val(ypos));
     raise_if_error();
@@ -708,6 +2051,7 @@ CAMLprim value caml_glfwSetWindowPos(value window, value xpos, value ypos)
 
 CAMLprim value caml_glfwGetWindowSize(value window)
 {
+    ML_PROFILE();
     int width, height;
     value ret;
 
@@ -722,6 +2066,7 @@ CAMLprim value caml_glfwGetWindowSize(value window)
 CAMLprim value caml_glfwSetWindowSizeLimits(
     value window, value minW, value minH, value maxW, value maxH)
 {
+    ML_PROFILE();
     int glfw_minW = Is_none(minW) ? GLFW_DONT_CARE : Int_val(Some_val(minW));
     int glfw_minH = Is_none(minH) ? GLFW_DONT_CARE : Int_val(Some_val(minH));
     int glfw_maxW = Is_none(maxW) ? GLFW_DONT_CARE : Int_val(Some_val(maxW));
@@ -735,6 +2080,7 @@ CAMLprim value caml_glfwSetWindowSizeLimits(
 
 CAMLprim value caml_glfwSetWindowAspectRatio(value window, value num, value den)
 {
+    ML_PROFILE();
     glfwSetWindowAspectRatio(
         Cptr_val(GLFWwindow*, window), Int_val(num), Int_val(den));
     raise_if_error();
@@ -743,6 +2089,7 @@ CAMLprim value caml_glfwSetWindowAspectRatio(value window, value num, value den)
 
 CAMLprim value caml_glfwSetWindowSize(value window, value width, value height)
 {
+    ML_PROFILE();
     glfwSetWindowSize(
         Cptr_val(GLFWwindow*, window), Int_val(width), Int_val(height));
     raise_if_error();
@@ -751,6 +2098,7 @@ CAMLprim value caml_glfwSetWindowSize(value window, value width, value height)
 
 CAMLprim value caml_glfwGetFramebufferSize(value window)
 {
+    ML_PROFILE();
     int width, height;
     value ret;
 
@@ -764,6 +2112,7 @@ CAMLprim value caml_glfwGetFramebufferSize(value window)
 
 CAMLprim value caml_glfwGetWindowFrameSize(value window)
 {
+    ML_PROFILE();
     int left, top, right, bottom;
     value ret;
 
@@ -780,6 +2129,7 @@ CAMLprim value caml_glfwGetWindowFrameSize(value window)
 
 CAMLprim value caml_glfwGetWindowContentScale(value window)
 {
+    ML_PROFILE();
     CAMLparam0();
     CAMLlocal3(ml_xscale, ml_yscale, ret);
     float xscale, yscale;
@@ -796,6 +2146,7 @@ CAMLprim value caml_glfwGetWindowContentScale(value window)
 
 CAMLprim value caml_glfwGetWindowOpacity(value window)
 {
+    ML_PROFILE();
     float opacity = glfwGetWindowOpacity(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return caml_copy_double(opacity);
@@ -803,6 +2154,7 @@ CAMLprim value caml_glfwGetWindowOpacity(value window)
 
 CAMLprim value caml_glfwSetWindowOpacity(value window, value time)
 {
+    ML_PROFILE();
     glfwSetWindowOpacity(Cptr_val(GLFWwindow*, window), Double_val(time));
     raise_if_error();
     return Val_unit;
@@ -810,6 +2162,7 @@ CAMLprim value caml_glfwSetWindowOpacity(value window, value time)
 
 CAMLprim value caml_glfwIconifyWindow(value window)
 {
+    ML_PROFILE();
     glfwIconifyWindow(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_unit;
@@ -817,6 +2170,7 @@ CAMLprim value caml_glfwIconifyWindow(value window)
 
 CAMLprim value caml_glfwRestoreWindow(value window)
 {
+    ML_PROFILE();
     glfwRestoreWindow(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_unit;
@@ -824,6 +2178,7 @@ CAMLprim value caml_glfwRestoreWindow(value window)
 
 CAMLprim value caml_glfwMaximizeWindow(value window)
 {
+    ML_PROFILE();
     glfwMaximizeWindow(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_unit;
@@ -831,6 +2186,7 @@ CAMLprim value caml_glfwMaximizeWindow(value window)
 
 CAMLprim value caml_glfwShowWindow(value window)
 {
+    ML_PROFILE();
     glfwShowWindow(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_unit;
@@ -838,6 +2194,7 @@ CAMLprim value caml_glfwShowWindow(value window)
 
 CAMLprim value caml_glfwHideWindow(value window)
 {
+    ML_PROFILE();
     glfwHideWindow(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_unit;
@@ -845,6 +2202,7 @@ CAMLprim value caml_glfwHideWindow(value window)
 
 CAMLprim value caml_glfwFocusWindow(value window)
 {
+    ML_PROFILE();
     glfwFocusWindow(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_unit;
@@ -852,6 +2210,7 @@ CAMLprim value caml_glfwFocusWindow(value window)
 
 CAMLprim value caml_glfwRequestWindowAttention(value window)
 {
+    ML_PROFILE();
     glfwRequestWindowAttention(Cptr_val(GLFWwindow*, window));
     raise_if_error();
     return Val_unit;
@@ -859,6 +2218,7 @@ CAMLprim value caml_glfwRequestWindowAttention(value window)
 
 CAMLprim value caml_glfwGetWindowMonitor(value window)
 {
+    ML_PROFILE();
     GLFWmonitor* monitor = glfwGetWindowMonitor(Cptr_val(GLFWwindow*, window));
 
     raise_if_error();
@@ -869,6 +2229,7 @@ CAMLprim value caml_glfwSetWindowMonitor(
     value window, value monitor, value xpos, value ypos,
     value width, value height, value refreshRate)
 {
+    ML_PROFILE();
     GLFWmonitor* glfw_monitor =
         Is_none(monitor) ? NULL : Cptr_val(GLFWmonitor*, Some_val(monitor));
     int glfw_refresh_rate =
@@ -891,6 +2252,7 @@ CAMLprim value caml_glfwSetWindowMonitor_byte(value* val_array, int val_count)
 
 CAMLprim value caml_glfwGetWindowAttrib(value window, value attribute)
 {
+    ML_PROFILE();
     const int offset = Int_val(attribute);
     int glfw_val = glfwGetWindowAttrib(
         Cptr_val(GLFWwindow*, window),
@@ -946,6 +2308,7 @@ CAMLprim value caml_glfwGetWindowAttrib(value window, value attribute)
 
 CAMLprim value caml_glfwSetWindowAttrib(value window, value hint, value ml_val)
 {
+    ML_PROFILE();
     const int offset = Int_val(hint);
     /* All updateable attributes are booleans at the moment. */
     const int glfw_val = Int_val(ml_val);
@@ -956,139 +2319,631 @@ CAMLprim value caml_glfwSetWindowAttrib(value window, value hint, value ml_val)
     return Val_unit;
 }
 
-void window_pos_callback_stub(GLFWwindow* window, int xpos, int ypos)
+/* Frame statistics. Windows collecting them keep a sample for each of
+   their last frames, ending when swapBuffers returns, of the metrics below
+   in the order getFrameStatsInto reports them: the time since the previous
+   frame ended, the time swapBuffers blocked, the time spent in pollEvents
+   and pollEventsBatch, and the time the callbacks of the window ran. */
+#define ML_FRAME_STATS_SIZE 256
+
+enum ml_frame_metric
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    FrameTime,
+    SwapTime,
+    PollTime,
+    DispatchTime,
+    FrameMetricCount
+};
 
-    caml_callback3(ml_window_callbacks->window_pos, Val_cptr(window),
-                   Val_int(xpos), Val_int(ypos));
-}
+struct ml_frame_stats
+{
+    unsigned int count;
+    unsigned int next;
+    uint64_t last_swap;
+    uint64_t poll_mark;
+    uint64_t dispatch;
+    uint64_t samples[FrameMetricCount][ML_FRAME_STATS_SIZE];
+};
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowPosCallback, window_pos)
+/* Timestamps are only taken while some window collects statistics. Time
+   spent polling is common to all windows, which keep the value of the
+   running total at the start of their current frame. */
+static unsigned int frame_stats_windows = 0;
+static uint64_t poll_ticks = 0;
 
-void window_size_callback_stub(GLFWwindow* window, int width, int height)
+static inline uint64_t begin_dispatch(void)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-
-    caml_callback3(ml_window_callbacks->window_size, Val_cptr(window),
-                   Val_int(width), Val_int(height));
+    return frame_stats_windows > 0 ? glfwGetTimerValue() : 0;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowSizeCallback, window_size)
-
-void window_close_callback_stub(GLFWwindow* window)
+static inline void end_dispatch(GLFWwindow* window, uint64_t start)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    struct ml_frame_stats* stats;
 
-    caml_callback(ml_window_callbacks->window_close, Val_cptr(window));
+    if (start == 0)
+        return;
+    stats = Window_data(window)->frame_stats;
+    if (stats != NULL)
+        stats->dispatch += glfwGetTimerValue() - start;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowCloseCallback, window_close)
-
-void window_refresh_callback_stub(GLFWwindow* window)
+static void dispatch_callback(GLFWwindow* window, value closure, value arg)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    const uint64_t start = begin_dispatch();
+    const double minor_words = begin_allocation_count();
 
-    caml_callback(ml_window_callbacks->window_refresh, Val_cptr(window));
+    caml_callback(closure, arg);
+    end_allocation_count(minor_words);
+    end_dispatch(window, start);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowRefreshCallback, window_refresh)
-
-void window_focus_callback_stub(GLFWwindow* window, int focused)
+static void dispatch_callback2(
+    GLFWwindow* window, value closure, value arg1, value arg2)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    const uint64_t start = begin_dispatch();
+    const double minor_words = begin_allocation_count();
 
-    caml_callback2(
-        ml_window_callbacks->window_focus, Val_cptr(window), Val_bool(focused));
+    caml_callback2(closure, arg1, arg2);
+    end_allocation_count(minor_words);
+    end_dispatch(window, start);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowFocusCallback, window_focus)
-
-void window_iconify_callback_stub(GLFWwindow* window, int iconified)
+static void dispatch_callback3(
+    GLFWwindow* window, value closure, value arg1, value arg2, value arg3)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    const uint64_t start = begin_dispatch();
+    const double minor_words = begin_allocation_count();
 
-    caml_callback2(ml_window_callbacks->window_iconify, Val_cptr(window),
-                   Val_bool(iconified));
+    caml_callback3(closure, arg1, arg2, arg3);
+    end_allocation_count(minor_words);
+    end_dispatch(window, start);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowIconifyCallback, window_iconify)
-
-void window_maximize_callback_stub(GLFWwindow* window, int maximized)
+static void dispatch_callbackN(
+    GLFWwindow* window, value closure, int narg, value* args)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    const uint64_t start = begin_dispatch();
+    const double minor_words = begin_allocation_count();
 
-    caml_callback2(ml_window_callbacks->window_maximize, Val_cptr(window),
-                   Val_bool(maximized));
+    caml_callbackN(closure, narg, args);
+    end_allocation_count(minor_words);
+    end_dispatch(window, start);
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowMaximizeCallback, window_maximize)
-
-void framebuffer_size_callback_stub(GLFWwindow* window, int width, int height)
+static void free_frame_stats(struct ml_window_data* ml_window_data)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-
-    caml_callback3(ml_window_callbacks->framebuffer_size, Val_cptr(window),
-                   Val_int(width), Val_int(height));
+    if (ml_window_data->frame_stats == NULL)
+        return;
+    free(ml_window_data->frame_stats);
+    ml_window_data->frame_stats = NULL;
+    --frame_stats_windows;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetFramebufferSizeCallback, framebuffer_size)
-
-void window_content_scale_callback_stub(GLFWwindow* window, float xscale,
-                                        float yscale)
+/* Terminating the library destroys every window, whose statistics are then
+   no longer collected. */
+static void forget_frame_stats(void)
 {
-    CAMLparam0();
-    CAMLlocal2(ml_xscale, ml_yscale);
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-
-    ml_xscale = caml_copy_double(xscale);
-    ml_yscale = caml_copy_double(yscale);
-    caml_callback3(ml_window_callbacks->window_content_scale, Val_cptr(window),
-                   ml_xscale, ml_yscale);
-    CAMLreturn0;
+    frame_stats_windows = 0;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetWindowContentScaleCallback, window_content_scale)
-
-CAMLprim value caml_glfwPollEvents(CAMLvoid)
+static void record_frame(
+    struct ml_frame_stats* stats, uint64_t swap_start, uint64_t swap_end)
 {
-    glfwPollEvents();
-    raise_if_error();
-    return Val_unit;
+    if (stats->last_swap != 0)
+    {
+        const unsigned int i = stats->next;
+
+        stats->samples[FrameTime][i] = swap_end - stats->last_swap;
+        stats->samples[SwapTime][i] = swap_end - swap_start;
+        stats->samples[PollTime][i] = poll_ticks - stats->poll_mark;
+        stats->samples[DispatchTime][i] = stats->dispatch;
+        stats->next = (i + 1) % ML_FRAME_STATS_SIZE;
+        if (stats->count < ML_FRAME_STATS_SIZE)
+            ++stats->count;
+    }
+    stats->last_swap = swap_end;
+    stats->poll_mark = poll_ticks;
+    stats->dispatch = 0;
 }
 
-CAMLprim value caml_glfwWaitEvents(CAMLvoid)
+/* Returns whether the event was coalesced, in which case it must not be
+   delivered right away. Coalesced events are profiled here rather than by
+   the callback stubs, which only count the events they deliver. */
+static int coalesce_event(
+    GLFWwindow* window, enum ml_coalescable_event type, double x, double y)
 {
-    glfwWaitEvents();
+    struct ml_window_data* ml_window_data = Window_data(window);
+    struct ml_coalesced_event* event = ml_window_data->coalesced + type;
+
+    if (delivering_coalesced_events || event->policy == NoCoalescing)
+        return 0;
+
+    ML_PROFILE();
+    if (event->pending && event->policy == Accumulate)
+    {
+        event->x += x;
+        event->y += y;
+    }
+    else
+    {
+        event->x = x;
+        event->y = y;
+    }
+    event->pending = 1;
+    if (!ml_window_data->has_pending_events)
+    {
+        ml_window_data->has_pending_events = 1;
+        ml_window_data->next_pending = pending_windows;
+        pending_windows = ml_window_data;
+    }
+    return 1;
+}
+
+void window_pos_callback_stub(GLFWwindow* window, int xpos, int ypos)
+{
+    if (coalesce_event(window, CoalescedWindowPos, xpos, ypos))
+        return;
+
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, WindowPosEvent, xpos, ypos, 0, 0);
+        return;
+    }
+    acquire_runtime();
+    if (Window_callbacks(window)->window_pos == Val_unit)
+        return;
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback3(
+        window, ml_window_callbacks->window_pos, Val_cptr(window),
+        Val_int(xpos), Val_int(ypos));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowPosCallback, window_pos)
+
+void window_size_callback_stub(GLFWwindow* window, int width, int height)
+{
+    if (coalesce_event(window, CoalescedWindowSize, width, height))
+        return;
+
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, WindowSizeEvent, width, height, 0, 0);
+        return;
+    }
+    acquire_runtime();
+    if (Window_callbacks(window)->window_size == Val_unit)
+        return;
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback3(window, ml_window_callbacks->window_size,
+                       Val_cptr(window), Val_int(width), Val_int(height));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowSizeCallback, window_size)
+
+void window_close_callback_stub(GLFWwindow* window)
+{
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, WindowCloseEvent, 0, 0, 0, 0);
+        return;
+    }
+    acquire_runtime();
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback(window, ml_window_callbacks->window_close,
+                      Val_cptr(window));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowCloseCallback, window_close)
+
+void window_refresh_callback_stub(GLFWwindow* window)
+{
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, WindowRefreshEvent, 0, 0, 0, 0);
+        return;
+    }
+    acquire_runtime();
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback(window, ml_window_callbacks->window_refresh,
+                      Val_cptr(window));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowRefreshCallback, window_refresh)
+
+void window_focus_callback_stub(GLFWwindow* window, int focused)
+{
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, WindowFocusEvent, focused, 0, 0, 0);
+        return;
+    }
+    acquire_runtime();
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback2(window, ml_window_callbacks->window_focus,
+                       Val_cptr(window), Val_bool(focused));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowFocusCallback, window_focus)
+
+void window_iconify_callback_stub(GLFWwindow* window, int iconified)
+{
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, WindowIconifyEvent, iconified, 0, 0, 0);
+        return;
+    }
+    acquire_runtime();
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback2(window, ml_window_callbacks->window_iconify,
+                       Val_cptr(window), Val_bool(iconified));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowIconifyCallback, window_iconify)
+
+void window_maximize_callback_stub(GLFWwindow* window, int maximized)
+{
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, WindowMaximizeEvent, maximized, 0, 0, 0);
+        return;
+    }
+    acquire_runtime();
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback2(window, ml_window_callbacks->window_maximize,
+                       Val_cptr(window), Val_bool(maximized));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowMaximizeCallback, window_maximize)
+
+void framebuffer_size_callback_stub(GLFWwindow* window, int width, int height)
+{
+    if (coalesce_event(window, CoalescedFramebufferSize, width, height))
+        return;
+
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, FramebufferSizeEvent, width, height, 0, 0);
+        return;
+    }
+    acquire_runtime();
+    if (Window_callbacks(window)->framebuffer_size == Val_unit)
+        return;
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback3(window, ml_window_callbacks->framebuffer_size,
+                       Val_cptr(window), Val_int(width), Val_int(height));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetFramebufferSizeCallback, framebuffer_size)
+
+void window_content_scale_callback_stub(GLFWwindow* window, float xscale,
+                                        float yscale)
+{
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_double_event(
+            window, WindowContentScaleEvent, xscale, yscale);
+        return;
+    }
+    acquire_runtime();
+
+    CAMLparam0();
+    CAMLlocal2(ml_xscale, ml_yscale);
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    ml_xscale = caml_copy_double(xscale);
+    ml_yscale = caml_copy_double(yscale);
+    dispatch_callback3(window, ml_window_callbacks->window_content_scale,
+                       Val_cptr(window), ml_xscale, ml_yscale);
+    CAMLreturn0;
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetWindowContentScaleCallback, window_content_scale)
+
+/* Called by every stub processing events, before GLFW does. */
+static void begin_event_processing(void)
+{
+    delivering_coalesced_events = 0;
+    delivering_window = NULL;
+    reset_profile_callback();
+    ++input_epoch;
+    if (gamma_transitions != NULL)
+        advance_gamma_transitions();
+    advance_cursor_animations();
+}
+
+CAMLprim value caml_glfwPollEvents(CAMLvoid)
+{
+    ML_PROFILE_TRACED();
+    const uint64_t start = begin_dispatch();
+
+    begin_event_processing();
+    glfwPollEvents();
+    raise_if_error();
+    flush_coalesced_events();
+    if (start != 0)
+        poll_ticks += glfwGetTimerValue() - start;
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwWaitEvents(CAMLvoid)
+{
+    ML_PROFILE_TRACED();
+    begin_event_processing();
+    release_runtime();
+    glfwWaitEvents();
+    acquire_runtime();
     raise_if_error();
+    flush_coalesced_events();
     return Val_unit;
 }
 
 CAMLprim value caml_glfwWaitEventsTimeout(value timeout)
 {
-    glfwWaitEventsTimeout(Double_val(timeout));
+    ML_PROFILE_TRACED();
+    begin_event_processing();
+    const double seconds = Double_val(timeout);
+
+    release_runtime();
+    glfwWaitEventsTimeout(seconds);
+    acquire_runtime();
     raise_if_error();
+    flush_coalesced_events();
     return Val_unit;
 }
 
 CAMLprim value caml_glfwPostEmptyEvent(CAMLvoid)
 {
+    ML_PROFILE();
     glfwPostEmptyEvent();
     raise_if_error();
     return Val_unit;
 }
 
+/* GLFW only declares the functions returning the native display in
+   glfw3native.h, which requires the X11 or Wayland headers, and only defines
+   those of the backends it was built for. They are referenced weakly instead,
+   as is glfwGetPlatform, which appeared in GLFW 3.4 along with the ability to
+   build several backends into one library. The functions returning the file
+   descriptor of a connection come from the libraries of the backends, which
+   GLFW 3.3 links to but GLFW 3.4 loads with dlopen, keeping their symbols
+   local. They are looked up in the already loaded library in that case. */
+#if defined(__GNUC__) && defined(__unix__) && !defined(__APPLE__)
+# define ML_WEAK_DISPLAY_FUNCTIONS
+# include <dlfcn.h>
+extern int glfwGetPlatform(void) __attribute__((weak));
+extern void* glfwGetX11Display(void) __attribute__((weak));
+extern void* glfwGetWaylandDisplay(void) __attribute__((weak));
+extern int XConnectionNumber(void* display) __attribute__((weak));
+extern int wl_display_get_fd(void* display) __attribute__((weak));
+
+# ifndef GLFW_PLATFORM_X11
+#  define GLFW_PLATFORM_WAYLAND 0x00060003
+#  define GLFW_PLATFORM_X11 0x00060004
+# endif
+
+typedef int (*ml_display_fd_function)(void*);
+
+static ml_display_fd_function find_display_fd_function(
+    ml_display_fd_function linked, const char* library, const char* name)
+{
+    void* handle;
+    void* function = NULL;
+
+    if (linked != NULL)
+        return linked;
+    handle = dlopen(library, RTLD_LAZY | RTLD_NOLOAD);
+    if (handle != NULL)
+    {
+        /* GLFW keeps its own reference until it terminates. */
+        function = dlsym(handle, name);
+        dlclose(handle);
+    }
+    return (ml_display_fd_function)function;
+}
+#endif
+
+CAMLprim value caml_getEventFd(CAMLvoid)
+{
+    int fd = -1;
+#ifdef ML_WEAK_DISPLAY_FUNCTIONS
+    /* Zero with GLFW 3.3, which has a single backend. */
+    const int platform = glfwGetPlatform != NULL ? glfwGetPlatform() : 0;
+    ml_display_fd_function get_fd = NULL;
+    void* display = NULL;
+
+    raise_if_error();
+    if (glfwGetX11Display != NULL
+        && (platform == 0 || platform == GLFW_PLATFORM_X11))
+    {
+        display = glfwGetX11Display();
+        get_fd = find_display_fd_function(
+            XConnectionNumber, "libX11.so.6", "XConnectionNumber");
+    }
+    else if (glfwGetWaylandDisplay != NULL
+             && (platform == 0 || platform == GLFW_PLATFORM_WAYLAND))
+    {
+        display = glfwGetWaylandDisplay();
+        get_fd = find_display_fd_function(
+            wl_display_get_fd, "libwayland-client.so.0", "wl_display_get_fd");
+    }
+    raise_if_error();
+    if (display != NULL && get_fd != NULL)
+        fd = get_fd(display);
+#endif
+    return fd < 0 ? Val_none : caml_alloc_some(Val_int(fd));
+}
+
+/* Waits until the timer reaches the deadline while processing events. Most
+   of the wait is spent in glfwWaitEventsTimeout, which tends to oversleep,
+   and the remainder spinning on the timer. The margin left for spinning
+   follows the oversleep observed so far. Events are polled once if the
+   deadline leaves no time to sleep. Returns whether events woke the thread
+   before its timeout, stopping there when return_on_events is set. */
+#define ML_SPIN_MIN_MARGIN 0.0002
+
+static double sleep_overshoot = 0.001;
+
+static int wait_until(uint64_t deadline, int return_on_events)
+{
+    const uint64_t frequency = glfwGetTimerFrequency();
+    int waited = 0, woken = 0;
+    uint64_t now;
+
+    raise_if_error();
+    begin_event_processing();
+    release_runtime();
+    while ((now = glfwGetTimerValue()) < deadline)
+    {
+        const double remaining = (double)(deadline - now) / frequency;
+        const double margin = 2 * sleep_overshoot + ML_SPIN_MIN_MARGIN;
+
+        if (remaining > margin)
+        {
+            const double timeout = remaining - margin;
+            double elapsed;
+
+            waited = 1;
+            glfwWaitEventsTimeout(timeout);
+            elapsed = (double)(glfwGetTimerValue() - now) / frequency;
+            if (elapsed < timeout)
+            {
+                woken = 1;
+                if (return_on_events)
+                    break;
+            }
+            else
+                sleep_overshoot += ((elapsed - timeout) - sleep_overshoot) / 8;
+            /* A callback may have taken the runtime back. */
+            if (!runtime_released)
+                release_runtime();
+        }
+#ifdef ML_X86_SIMD
+        else
+            _mm_pause();
+#endif
+    }
+    if (!waited)
+        glfwPollEvents();
+    acquire_runtime();
+    raise_if_error();
+    flush_coalesced_events();
+    return woken;
+}
+
+CAMLprim value caml_waitUntil_unboxed(double deadline)
+{
+    ML_PROFILE_TRACED();
+    const uint64_t now = glfwGetTimerValue();
+    const double remaining =
+        (deadline - glfwGetTime()) * glfwGetTimerFrequency();
+
+    raise_if_error();
+    return Val_bool(wait_until(
+        !(remaining > 0) ? now
+        : remaining < (double)(UINT64_MAX - now) ? now + (uint64_t)remaining
+        : UINT64_MAX, 1));
+}
+
+CAMLprim value caml_waitUntil(value deadline)
+{
+    return caml_waitUntil_unboxed(Double_val(deadline));
+}
+
+struct ml_frame_limiter
+{
+    uint64_t period;
+    uint64_t deadline;
+    uint64_t last;
+};
+
+CAMLprim value caml_createFrameLimiter(value period)
+{
+    const double ticks = Double_val(period) * glfwGetTimerFrequency();
+    struct ml_frame_limiter* limiter;
+
+    raise_if_error();
+    if (!(ticks > 0) || !(ticks < (double)UINT64_MAX / 4))
+        caml_invalid_argument(
+            "createFrameLimiter: period must be positive and finite.");
+    limiter = malloc(sizeof(*limiter));
+    if (limiter == NULL)
+        caml_raise_out_of_memory();
+    limiter->period = ticks;
+    limiter->deadline = 0;
+    limiter->last = 0;
+    return Val_cptr(limiter);
+}
+
+CAMLprim value caml_destroyFrameLimiter(value limiter)
+{
+    free(Cptr_val(struct ml_frame_limiter*, limiter));
+    return Val_unit;
+}
+
+/* The first call only starts the cadence. Deadlines then follow each other
+   by one period, unless a whole period was missed in which case the
+   cadence restarts from the current frame rather than trying to catch up. */
+CAMLprim double caml_limitFrame_unboxed(value ml_limiter)
+{
+    ML_PROFILE_TRACED();
+    struct ml_frame_limiter* limiter =
+        Cptr_val(struct ml_frame_limiter*, ml_limiter);
+    uint64_t now, achieved;
+
+    /* The deadline is 0 on the first call, which only polls events. */
+    wait_until(limiter->deadline, 0);
+    now = glfwGetTimerValue();
+    raise_if_error();
+    achieved = limiter->last == 0 ? 0 : now - limiter->last;
+    limiter->last = now;
+    limiter->deadline += limiter->period;
+    if (limiter->deadline + limiter->period < now)
+        limiter->deadline = now + limiter->period;
+    return (double)achieved / glfwGetTimerFrequency();
+}
+
+CAMLprim value caml_limitFrame(value limiter)
+{
+    return caml_copy_double(caml_limitFrame_unboxed(limiter));
+}
+
 CAMLprim value caml_glfwGetInputMode(value window, value mode)
 {
+    ML_PROFILE();
     int v = glfwGetInputMode(Cptr_val(GLFWwindow*, window),
                              Int_val(mode) + GLFW_CURSOR);
 
@@ -1100,6 +2955,7 @@ CAMLprim value caml_glfwGetInputMode(value window, value mode)
 
 CAMLprim value caml_glfwSetInputMode(value window, value mode, value v)
 {
+    ML_PROFILE();
     int glfw_val =
         Int_val(mode) == 0 ? Int_val(v) + GLFW_CURSOR_NORMAL : Bool_val(v);
 
@@ -1111,6 +2967,7 @@ CAMLprim value caml_glfwSetInputMode(value window, value mode, value v)
 
 CAMLprim value caml_glfwRawMouseMotionSupported(CAMLvoid)
 {
+    ML_PROFILE();
     const int ret = glfwRawMouseMotionSupported();
     raise_if_error();
     return Val_bool(ret);
@@ -1118,6 +2975,7 @@ CAMLprim value caml_glfwRawMouseMotionSupported(CAMLvoid)
 
 CAMLprim value caml_glfwGetKeyName(value key, value scancode)
 {
+    ML_PROFILE();
     const char* name =
         glfwGetKeyName(ml_to_glfw_key[Int_val(key)], Int_val(scancode));
 
@@ -1127,6 +2985,7 @@ CAMLprim value caml_glfwGetKeyName(value key, value scancode)
 
 CAMLprim value caml_glfwGetKeyScancode(value key)
 {
+    ML_PROFILE();
     int ret = glfwGetKeyScancode(ml_to_glfw_key[Int_val(key)]);
     raise_if_error();
     return Val_int(ret);
@@ -1134,6 +2993,7 @@ CAMLprim value caml_glfwGetKeyScancode(value key)
 
 CAMLprim value caml_glfwGetKey(value window, value key)
 {
+    ML_PROFILE();
     int ret =
         glfwGetKey(Cptr_val(GLFWwindow*, window), ml_to_glfw_key[Int_val(key)]);
     raise_if_error();
@@ -1142,6 +3002,7 @@ CAMLprim value caml_glfwGetKey(value window, value key)
 
 CAMLprim value caml_glfwGetMouseButton(value window, value button)
 {
+    ML_PROFILE();
     int ret =
         glfwGetMouseButton(Cptr_val(GLFWwindow*, window), Int_val(button));
     raise_if_error();
@@ -1150,6 +3011,7 @@ CAMLprim value caml_glfwGetMouseButton(value window, value button)
 
 CAMLprim value caml_glfwGetCursorPos(value window)
 {
+    ML_PROFILE();
     CAMLparam0();
     CAMLlocal3(ml_xpos, ml_ypos, ret);
     double xpos, ypos;
@@ -1166,6 +3028,7 @@ CAMLprim value caml_glfwGetCursorPos(value window)
 
 CAMLprim value caml_glfwSetCursorPos(value window, value xpos, value ypos)
 {
+    ML_PROFILE();
     glfwSetCursorPos(
         Cptr_val(GLFWwindow*, window), Double_val(xpos), Double_val(ypos));
     raise_if_error();
@@ -1173,13 +3036,23 @@ CAMLprim value caml_glfwSetCursorPos(value window, value xpos, value ypos)
 }
 
 CAMLprim value caml_glfwCreateCursor(value image, value xhot, value yhot)
+{
+    ML_PROFILE();
+    GLFWimage glfw_image;
+    GLFWcursor* ret;
+
+    image_of_ml_image(&glfw_image, image, 0);
+    ret = glfwCreateCursor(&glfw_image, Int_val(xhot), Int_val(yhot));
+    raise_if_error();
+    return Val_cptr(ret);
+}
+
+CAMLprim value caml_createCursorBigarray(value image, value xhot, value yhot)
 {
     GLFWimage glfw_image;
     GLFWcursor* ret;
 
-    glfw_image.width = Int_val(Field(image, 0));
-    glfw_image.height = Int_val(Field(image, 1));
-    glfw_image.pixels = Bytes_val(Field(image, 2));
+    image_of_ml_image(&glfw_image, image, 1);
     ret = glfwCreateCursor(&glfw_image, Int_val(xhot), Int_val(yhot));
     raise_if_error();
     return Val_cptr(ret);
@@ -1187,6 +3060,7 @@ CAMLprim value caml_glfwCreateCursor(value image, value xhot, value yhot)
 
 CAMLprim value caml_glfwCreateStandardCursor(value shape)
 {
+    ML_PROFILE();
     GLFWcursor* ret =
         glfwCreateStandardCursor(GLFW_ARROW_CURSOR + Int_val(shape));
     raise_if_error();
@@ -1195,85 +3069,440 @@ CAMLprim value caml_glfwCreateStandardCursor(value shape)
 
 CAMLprim value caml_glfwDestroyCursor(value cursor)
 {
+    ML_PROFILE();
     glfwDestroyCursor(Cptr_val(GLFWcursor*, cursor));
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwSetCursor(value window, value cursor)
+CAMLprim value caml_glfwSetCursor(value ml_window, value cursor)
 {
-    glfwSetCursor(Cptr_val(GLFWwindow*, window), Cptr_val(GLFWcursor*, cursor));
+    ML_PROFILE();
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_data* ml_window_data = glfwGetWindowUserPointer(window);
+
+    raise_if_error();
+    stop_cursor_animation(ml_window_data);
+    glfwSetCursor(window, Cptr_val(GLFWcursor*, cursor));
     raise_if_error();
     return Val_unit;
 }
 
-void key_callback_stub(
-    GLFWwindow* window, int key, int scancode, int action, int mods)
+/* Cursors created for animations are shared between identical frames,
+   found by a hash of their content. Entries are reference counted by the
+   frames using them. Terminating the library destroys all cursors, in which
+   case entries are kept with a NULL cursor, which is recreated on demand. */
+struct ml_cached_cursor
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-    value args[] = {
-        Val_cptr(window), Val_int(glfw_to_ml_key[key - GLFW_KEY_FIRST]),
-        Val_int(scancode), Val_int(action), caml_list_of_flags(mods, 4)
-    };
+    GLFWcursor* cursor;
+    uint64_t hash;
+    int width, height, xhot, yhot;
+    unsigned int references;
+    struct ml_cached_cursor* next;
+    unsigned char pixels[];
+};
 
-    caml_callbackN(
-        ml_window_callbacks->key, sizeof(args) / sizeof(*args), args);
-}
+static struct ml_cached_cursor* cursor_cache = NULL;
 
-CAML_WINDOW_SETTER_STUB(glfwSetKeyCallback, key)
+#define ML_FNV1A_OFFSET_BASIS 0xcbf29ce484222325ull
 
-void character_callback_stub(GLFWwindow* window, unsigned int codepoint)
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    const unsigned char* bytes = data;
 
-    caml_callback2(
-        ml_window_callbacks->character, Val_cptr(window), Val_int(codepoint));
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetCharCallback, character)
+static struct ml_cached_cursor* acquire_cached_cursor(
+    const GLFWimage* image, int xhot, int yhot)
+{
+    const size_t size = (size_t)image->width * image->height * 4;
+    const int header[] = { image->width, image->height, xhot, yhot };
+    const uint64_t hash =
+        fnv1a(fnv1a(ML_FNV1A_OFFSET_BASIS, header, sizeof(header)),
+              image->pixels, size);
+    struct ml_cached_cursor* entry = cursor_cache;
+
+    while (entry != NULL
+           && (entry->hash != hash || entry->width != image->width
+               || entry->height != image->height || entry->xhot != xhot
+               || entry->yhot != yhot
+               || memcmp(entry->pixels, image->pixels, size) != 0))
+        entry = entry->next;
+    if (entry == NULL)
+    {
+        entry = malloc(sizeof(*entry) + size);
+        if (entry == NULL)
+            return NULL;
+        entry->cursor = NULL;
+        entry->hash = hash;
+        entry->width = image->width;
+        entry->height = image->height;
+        entry->xhot = xhot;
+        entry->yhot = yhot;
+        entry->references = 0;
+        memcpy(entry->pixels, image->pixels, size);
+        entry->next = cursor_cache;
+        cursor_cache = entry;
+    }
+    if (entry->cursor == NULL)
+        entry->cursor = glfwCreateCursor(image, xhot, yhot);
+    ++entry->references;
+    return entry;
+}
 
-void character_mods_callback_stub(
-    GLFWwindow* window, unsigned int codepoint, int mods)
+static void release_cached_cursor(struct ml_cached_cursor* entry)
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-    value ml_mods = caml_list_of_flags(mods, 4);
+    struct ml_cached_cursor** iter = &cursor_cache;
+
+    if (--entry->references > 0)
+        return;
+    while (*iter != entry)
+        iter = &(*iter)->next;
+    *iter = entry->next;
+    if (entry->cursor != NULL)
+        glfwDestroyCursor(entry->cursor);
+    free(entry);
+}
 
-    caml_callback3(ml_window_callbacks->character_mods, Val_cptr(window),
-                   Val_int(codepoint), ml_mods);
+static void invalidate_cursor_cache(void)
+{
+    for (struct ml_cached_cursor* entry = cursor_cache; entry != NULL;
+         entry = entry->next)
+        entry->cursor = NULL;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetCharModsCallback, character_mods)
+struct ml_cursor_frame
+{
+    struct ml_cached_cursor* cursor;
+    double duration;
+};
 
-void mouse_button_callback_stub(
-    GLFWwindow* window, int button, int action, int mods)
+struct ml_cursor_animation
 {
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
-    value args[] = {
-        Val_cptr(window), Val_int(button), Val_bool(action),
-        caml_list_of_flags(mods, 4)
-    };
+    unsigned int frame_count;
+    double total_duration;
+    struct ml_cursor_frame frames[];
+};
+
+/* Windows playing a cursor animation. */
+static struct ml_window_data* animated_windows = NULL;
 
-    caml_callbackN(
-        ml_window_callbacks->mouse_button, sizeof(args) / sizeof(*args), args);
+static void stop_cursor_animation(struct ml_window_data* ml_window_data)
+{
+    struct ml_window_data** iter = &animated_windows;
+
+    if (ml_window_data->cursor_animation == NULL)
+        return;
+    while (*iter != ml_window_data)
+        iter = &(*iter)->next_animated;
+    *iter = ml_window_data->next_animated;
+    ml_window_data->cursor_animation = NULL;
 }
 
-CAML_WINDOW_SETTER_STUB(glfwSetMouseButtonCallback, mouse_button)
+/* Terminating the library destroys every window, so none may be left in
+   the list for the next initialization to advance. */
+static void stop_cursor_animations(void)
+{
+    while (animated_windows != NULL)
+        stop_cursor_animation(animated_windows);
+}
 
-void cursor_pos_callback_stub(GLFWwindow* window, double xpos, double ypos)
+static void advance_cursor_animations(void)
 {
-    CAMLparam0();
-    CAMLlocal2(ml_xpos, ml_ypos);
-    struct ml_window_callbacks* ml_window_callbacks =
-        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+    const double now = animated_windows == NULL ? 0.0 : glfwGetTime();
 
-    ml_xpos = caml_copy_double(xpos);
-    ml_ypos = caml_copy_double(ypos);
-    caml_callback3(
-        ml_window_callbacks->cursor_pos, Val_cptr(window), ml_xpos, ml_ypos);
+    for (struct ml_window_data* iter = animated_windows; iter != NULL;
+         iter = iter->next_animated)
+    {
+        const struct ml_cursor_animation* animation = iter->cursor_animation;
+        const unsigned int frame = iter->cursor_frame;
+        double elapsed = now - iter->cursor_frame_start;
+
+        if (elapsed >= animation->total_duration)
+        {
+            const double loops = floor(elapsed / animation->total_duration);
+
+            iter->cursor_frame_start += loops * animation->total_duration;
+            elapsed -= loops * animation->total_duration;
+        }
+        while (elapsed >= animation->frames[iter->cursor_frame].duration)
+        {
+            elapsed -= animation->frames[iter->cursor_frame].duration;
+            iter->cursor_frame_start +=
+                animation->frames[iter->cursor_frame].duration;
+            iter->cursor_frame =
+                (iter->cursor_frame + 1) % animation->frame_count;
+        }
+        if (iter->cursor_frame != frame)
+            glfwSetCursor(iter->window,
+                          animation->frames[iter->cursor_frame].cursor->cursor);
+    }
+}
+
+CAMLprim value caml_createCursorAnimation(value frames, value xhot, value yhot)
+{
+    const unsigned int count = Wosize_val(frames);
+    struct ml_cursor_animation* animation;
+
+    if (count == 0)
+        caml_invalid_argument("createCursorAnimation: no frames.");
+    for (unsigned int i = 0; i < count; ++i)
+        if (!(Double_val(Field(Field(frames, i), 1)) > 0.0))
+            caml_invalid_argument(
+                "createCursorAnimation: frame durations must be positive.");
+    animation = malloc(sizeof(*animation) + count * sizeof(*animation->frames));
+    if (animation == NULL)
+        caml_raise_out_of_memory();
+    animation->frame_count = count;
+    animation->total_duration = 0.0;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        struct ml_cursor_frame* frame = animation->frames + i;
+        GLFWimage image;
+
+        image_of_ml_image(&image, Field(Field(frames, i), 0), 0);
+        frame->cursor =
+            acquire_cached_cursor(&image, Int_val(xhot), Int_val(yhot));
+        frame->duration = Double_val(Field(Field(frames, i), 1));
+        animation->total_duration += frame->duration;
+        if (frame->cursor == NULL || error_code != GLFW_NO_ERROR)
+        {
+            if (frame->cursor != NULL)
+                release_cached_cursor(frame->cursor);
+            while (i-- > 0)
+                release_cached_cursor(animation->frames[i].cursor);
+            free(animation);
+            raise_if_error();
+            caml_raise_out_of_memory();
+        }
+    }
+    return Val_cptr(animation);
+}
+
+CAMLprim value caml_destroyCursorAnimation(value ml_animation)
+{
+    struct ml_cursor_animation* animation =
+        Cptr_val(struct ml_cursor_animation*, ml_animation);
+    struct ml_window_data* iter = animated_windows;
+
+    while (iter != NULL)
+    {
+        struct ml_window_data* next = iter->next_animated;
+
+        if (iter->cursor_animation == animation)
+        {
+            stop_cursor_animation(iter);
+            glfwSetCursor(iter->window, NULL);
+        }
+        iter = next;
+    }
+    for (unsigned int i = 0; i < animation->frame_count; ++i)
+        release_cached_cursor(animation->frames[i].cursor);
+    free(animation);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_setCursorAnimation(value ml_window, value ml_animation)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_data* ml_window_data = glfwGetWindowUserPointer(window);
+
+    raise_if_error();
+    stop_cursor_animation(ml_window_data);
+    if (Is_none(ml_animation))
+        glfwSetCursor(window, NULL);
+    else
+    {
+        struct ml_cursor_animation* animation =
+            Cptr_val(struct ml_cursor_animation*, Some_val(ml_animation));
+
+        ml_window_data->cursor_animation = animation;
+        ml_window_data->cursor_frame = 0;
+        ml_window_data->cursor_frame_start = glfwGetTime();
+        ml_window_data->next_animated = animated_windows;
+        animated_windows = ml_window_data;
+        glfwSetCursor(window, animation->frames[0].cursor->cursor);
+    }
+    raise_if_error();
+    return Val_unit;
+}
+
+void key_callback_stub(
+    GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    ML_PROFILE_CALLBACK();
+    struct ml_window_data* ml_window_data = Window_data(window);
+
+    if (ml_window_data->track_input)
+    {
+        struct ml_input_state* state = &ml_window_data->input_state;
+
+        sync_input_edges(ml_window_data);
+        track_input(state->keys_down, state->keys_pressed,
+                    state->keys_released, glfw_to_ml_key[key - GLFW_KEY_FIRST],
+                    action);
+    }
+    if (ml_window_data->queue_events)
+    {
+        push_int_event(window, KeyEvent, key, scancode, action, mods);
+        return;
+    }
+    acquire_runtime();
+
+    const value ml_key = Val_int(glfw_to_ml_key[key - GLFW_KEY_FIRST]);
+
+    if (Window_callbacks(window)->key_bitset != Val_unit)
+    {
+        value args[] = {
+            Val_cptr(window), ml_key, Val_int(scancode), Val_int(action),
+            Val_int(mods & ML_KEY_MOD_MASK)
+        };
+
+        dispatch_callbackN(window, Window_callbacks(window)->key_bitset,
+                           sizeof(args) / sizeof(*args), args);
+    }
+    if (Window_callbacks(window)->key != Val_unit)
+    {
+        value args[] = {
+            Val_cptr(window), ml_key, Val_int(scancode), Val_int(action),
+            caml_list_of_flags(mods, 4)
+        };
+
+        dispatch_callbackN(window, Window_callbacks(window)->key,
+                           sizeof(args) / sizeof(*args), args);
+    }
+}
+
+CAML_WINDOW_SHARED_SETTER_STUB(
+    caml_glfwSetKeyCallback, glfwSetKeyCallback, key, key_bitset, key)
+CAML_WINDOW_SHARED_SETTER_STUB(
+    caml_glfwSetKeyCallbackBitset, glfwSetKeyCallback, key_bitset, key, key)
+
+void character_callback_stub(GLFWwindow* window, unsigned int codepoint)
+{
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, CharEvent, codepoint, 0, 0, 0);
+        return;
+    }
+    acquire_runtime();
+
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    dispatch_callback2(window, ml_window_callbacks->character, Val_cptr(window),
+                       Val_int(codepoint));
+}
+
+CAML_WINDOW_SETTER_STUB(glfwSetCharCallback, character)
+
+void character_mods_callback_stub(
+    GLFWwindow* window, unsigned int codepoint, int mods)
+{
+    ML_PROFILE_CALLBACK();
+    acquire_runtime();
+    if (Window_callbacks(window)->character_mods_bitset != Val_unit)
+        dispatch_callback3(window,
+                           Window_callbacks(window)->character_mods_bitset,
+                           Val_cptr(window), Val_int(codepoint),
+                           Val_int(mods & ML_KEY_MOD_MASK));
+    if (Window_callbacks(window)->character_mods != Val_unit)
+    {
+        value ml_mods = caml_list_of_flags(mods, 4);
+
+        dispatch_callback3(window, Window_callbacks(window)->character_mods,
+                           Val_cptr(window), Val_int(codepoint), ml_mods);
+    }
+}
+
+CAML_WINDOW_SHARED_SETTER_STUB(
+    caml_glfwSetCharModsCallback, glfwSetCharModsCallback, character_mods,
+    character_mods_bitset, character_mods)
+CAML_WINDOW_SHARED_SETTER_STUB(
+    caml_glfwSetCharModsCallbackBitset, glfwSetCharModsCallback,
+    character_mods_bitset, character_mods, character_mods)
+
+void mouse_button_callback_stub(
+    GLFWwindow* window, int button, int action, int mods)
+{
+    ML_PROFILE_CALLBACK();
+    struct ml_window_data* ml_window_data = Window_data(window);
+
+    if (ml_window_data->track_input)
+    {
+        struct ml_input_state* state = &ml_window_data->input_state;
+
+        sync_input_edges(ml_window_data);
+        track_input(&state->buttons_down, &state->buttons_pressed,
+                    &state->buttons_released, button, action);
+    }
+    if (ml_window_data->queue_events)
+    {
+        push_int_event(
+            window, MouseButtonEvent, button, action, mods, 0);
+        return;
+    }
+    acquire_runtime();
+    if (Window_callbacks(window)->mouse_button_bitset != Val_unit)
+    {
+        value args[] = {
+            Val_cptr(window), Val_int(button), Val_bool(action),
+            Val_int(mods & ML_KEY_MOD_MASK)
+        };
+
+        dispatch_callbackN(
+            window, Window_callbacks(window)->mouse_button_bitset,
+            sizeof(args) / sizeof(*args), args);
+    }
+    if (Window_callbacks(window)->mouse_button != Val_unit)
+    {
+        value args[] = {
+            Val_cptr(window), Val_int(button), Val_bool(action),
+            caml_list_of_flags(mods, 4)
+        };
+
+        dispatch_callbackN(window, Window_callbacks(window)->mouse_button,
+                           sizeof(args) / sizeof(*args), args);
+    }
+}
+
+CAML_WINDOW_SHARED_SETTER_STUB(
+    caml_glfwSetMouseButtonCallback, glfwSetMouseButtonCallback, mouse_button,
+    mouse_button_bitset, mouse_button)
+CAML_WINDOW_SHARED_SETTER_STUB(
+    caml_glfwSetMouseButtonCallbackBitset, glfwSetMouseButtonCallback,
+    mouse_button_bitset, mouse_button, mouse_button)
+
+void cursor_pos_callback_stub(GLFWwindow* window, double xpos, double ypos)
+{
+    if (coalesce_event(window, CoalescedCursorPos, xpos, ypos))
+        return;
+
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_double_event(window, CursorPosEvent, xpos, ypos);
+        return;
+    }
+    acquire_runtime();
+    if (Window_callbacks(window)->cursor_pos == Val_unit)
+        return;
+
+    CAMLparam0();
+    CAMLlocal2(ml_xpos, ml_ypos);
+    struct ml_window_callbacks* ml_window_callbacks =
+        *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
+
+    ml_xpos = caml_copy_double(xpos);
+    ml_ypos = caml_copy_double(ypos);
+    dispatch_callback3(
+        window, ml_window_callbacks->cursor_pos, Val_cptr(window), ml_xpos,
+        ml_ypos);
     CAMLreturn0;
 }
 
@@ -1281,17 +3510,38 @@ CAML_WINDOW_SETTER_STUB(glfwSetCursorPosCallback, cursor_pos)
 
 void cursor_enter_callback_stub(GLFWwindow* window, int entered)
 {
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_int_event(window, CursorEnterEvent, entered, 0, 0, 0);
+        return;
+    }
+    acquire_runtime();
+
     struct ml_window_callbacks* ml_window_callbacks =
         *(struct ml_window_callbacks**)glfwGetWindowUserPointer(window);
 
-    caml_callback2(
-        ml_window_callbacks->cursor_enter, Val_cptr(window), Val_bool(entered));
+    dispatch_callback2(window, ml_window_callbacks->cursor_enter,
+                       Val_cptr(window), Val_bool(entered));
 }
 
 CAML_WINDOW_SETTER_STUB(glfwSetCursorEnterCallback, cursor_enter)
 
 void scroll_callback_stub(GLFWwindow* window, double xoffset, double yoffset)
 {
+    if (coalesce_event(window, CoalescedScroll, xoffset, yoffset))
+        return;
+
+    ML_PROFILE_CALLBACK();
+    if (Window_data(window)->queue_events)
+    {
+        push_double_event(window, ScrollEvent, xoffset, yoffset);
+        return;
+    }
+    acquire_runtime();
+    if (Window_callbacks(window)->scroll == Val_unit)
+        return;
+
     CAMLparam0();
     CAMLlocal2(ml_xoffset, ml_yoffset);
     struct ml_window_callbacks* ml_window_callbacks =
@@ -1299,8 +3549,8 @@ void scroll_callback_stub(GLFWwindow* window, double xoffset, double yoffset)
 
     ml_xoffset = caml_copy_double(xoffset);
     ml_yoffset = caml_copy_double(yoffset);
-    caml_callback3(
-        ml_window_callbacks->scroll, Val_cptr(window), ml_xoffset, ml_yoffset);
+    dispatch_callback3(window, ml_window_callbacks->scroll, Val_cptr(window),
+                       ml_xoffset, ml_yoffset);
     CAMLreturn0;
 }
 
@@ -1308,6 +3558,8 @@ CAML_WINDOW_SETTER_STUB(glfwSetScrollCallback, scroll)
 
 void drop_callback_stub(GLFWwindow* window, int count, const char** paths)
 {
+    ML_PROFILE_CALLBACK();
+    acquire_runtime();
     CAMLparam0();
     CAMLlocal2(ml_paths, str);
     struct ml_window_callbacks* ml_window_callbacks =
@@ -1322,188 +3574,729 @@ void drop_callback_stub(GLFWwindow* window, int count, const char** paths)
         Field(tmp, 1) = ml_paths;
         ml_paths = tmp;
     }
-    caml_callback2(ml_window_callbacks->drop, Val_cptr(window), ml_paths);
+    dispatch_callback2(window, ml_window_callbacks->drop, Val_cptr(window),
+                       ml_paths);
     CAMLreturn0;
 }
 
 CAML_WINDOW_SETTER_STUB(glfwSetDropCallback, drop)
 
-CAMLprim value caml_glfwJoystickPresent(value joy)
+static void update_window_callback_stubs(GLFWwindow* window)
 {
-    int ret = glfwJoystickPresent(Int_val(joy));
-    raise_if_error();
-    return Val_bool(ret);
+    struct ml_window_data* ml_window_data = Window_data(window);
+    struct ml_window_callbacks* ml_window_callbacks =
+        (struct ml_window_callbacks*)ml_window_data->callbacks;
+
+#define UPDATE_SHARED_CALLBACK_STUB(glfw_setter, name, shared)          \
+    glfw_setter(window,                                                 \
+                ml_window_callbacks->name != Val_unit                   \
+                || ml_window_callbacks->shared != Val_unit              \
+                || ml_window_data->forced_callbacks                     \
+                   & (ML_CALLBACK_BIT(name) | ML_CALLBACK_BIT(shared))  \
+                ? name##_callback_stub : NULL)
+#define UPDATE_CALLBACK_STUB(glfw_setter, name) \
+    UPDATE_SHARED_CALLBACK_STUB(glfw_setter, name, name)
+
+    UPDATE_CALLBACK_STUB(glfwSetWindowPosCallback, window_pos);
+    UPDATE_CALLBACK_STUB(glfwSetWindowSizeCallback, window_size);
+    UPDATE_CALLBACK_STUB(glfwSetWindowCloseCallback, window_close);
+    UPDATE_CALLBACK_STUB(glfwSetWindowRefreshCallback, window_refresh);
+    UPDATE_CALLBACK_STUB(glfwSetWindowFocusCallback, window_focus);
+    UPDATE_CALLBACK_STUB(glfwSetWindowIconifyCallback, window_iconify);
+    UPDATE_CALLBACK_STUB(glfwSetWindowMaximizeCallback, window_maximize);
+    UPDATE_CALLBACK_STUB(glfwSetFramebufferSizeCallback, framebuffer_size);
+    UPDATE_CALLBACK_STUB(
+        glfwSetWindowContentScaleCallback, window_content_scale);
+    UPDATE_SHARED_CALLBACK_STUB(glfwSetKeyCallback, key, key_bitset);
+    UPDATE_CALLBACK_STUB(glfwSetCharCallback, character);
+    UPDATE_SHARED_CALLBACK_STUB(
+        glfwSetCharModsCallback, character_mods, character_mods_bitset);
+    UPDATE_SHARED_CALLBACK_STUB(
+        glfwSetMouseButtonCallback, mouse_button, mouse_button_bitset);
+    UPDATE_CALLBACK_STUB(glfwSetCursorPosCallback, cursor_pos);
+    UPDATE_CALLBACK_STUB(glfwSetCursorEnterCallback, cursor_enter);
+    UPDATE_CALLBACK_STUB(glfwSetScrollCallback, scroll);
+    UPDATE_CALLBACK_STUB(glfwSetDropCallback, drop);
+
+#undef UPDATE_CALLBACK_STUB
+#undef UPDATE_SHARED_CALLBACK_STUB
 }
 
-CAMLprim value caml_glfwGetJoystickAxes(value joy)
+static void flush_coalesced_events(void)
 {
-    value ret;
-    int count;
-    const float* axes = glfwGetJoystickAxes(Int_val(joy), &count);
+    delivering_coalesced_events = 1;
+    while (pending_windows != NULL)
+    {
+        struct ml_coalesced_event* coalesced = pending_windows->coalesced;
+        GLFWwindow* window = pending_windows->window;
+
+        /* The window stays at the head of the list until all its events are
+           delivered, so those left behind by an exception are delivered by
+           the next flush. Callbacks cannot add windows to the list. */
+        delivering_window = pending_windows;
+        for (int type = 0;
+             type < CoalescableEventCount && delivering_window != NULL; ++type)
+        {
+            const double x = coalesced[type].x;
+            const double y = coalesced[type].y;
+
+            if (!coalesced[type].pending)
+                continue;
+            coalesced[type].pending = 0;
+            /* The stubs check themselves whether the callback was removed
+               since the event was coalesced. */
+            switch (type)
+            {
+            case CoalescedWindowPos:
+                window_pos_callback_stub(window, (int)x, (int)y);
+                break;
+
+            case CoalescedWindowSize:
+                window_size_callback_stub(window, (int)x, (int)y);
+                break;
+
+            case CoalescedFramebufferSize:
+                framebuffer_size_callback_stub(window, (int)x, (int)y);
+                break;
+
+            case CoalescedCursorPos:
+                cursor_pos_callback_stub(window, x, y);
+                break;
+
+            case CoalescedScroll:
+                scroll_callback_stub(window, x, y);
+            }
+        }
+        if (delivering_window != NULL)
+        {
+            pending_windows = delivering_window->next_pending;
+            delivering_window->has_pending_events = 0;
+        }
+    }
+    delivering_window = NULL;
+    delivering_coalesced_events = 0;
+}
+
+CAMLprim value caml_setEventCoalescing(value window, value type, value policy)
+{
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(Cptr_val(GLFWwindow*, window));
 
     raise_if_error();
-    ret = caml_alloc_float_array(count);
-    for (int i = 0; i < count; ++i)
-        Store_double_field(ret, i, axes[i]);
-    return ret;
+    if (Int_val(policy) == Accumulate && Int_val(type) != CoalescedScroll)
+        caml_invalid_argument(
+            "setEventCoalescing: only scroll events can be accumulated.");
+    ml_window_data->coalesced[Int_val(type)].policy = Int_val(policy);
+    return Val_unit;
 }
 
-CAMLprim value caml_glfwGetJoystickButtons(value joy)
+CAMLprim value caml_getEventCoalescing(value window, value type)
 {
-    value ret;
-    int count;
-    const unsigned char* buttons = glfwGetJoystickButtons(Int_val(joy), &count);
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(Cptr_val(GLFWwindow*, window));
 
     raise_if_error();
-    if (count == 0)
-        return Atom(0);
-    ret = caml_alloc_small(count, 0);
-    for (int i = 0; i < count; ++i)
-        Field(ret, i) = Val_bool(buttons[i] == GLFW_PRESS);
-    return ret;
+    return Val_int(ml_window_data->coalesced[Int_val(type)].policy);
 }
 
-CAMLprim value caml_glfwGetJoystickHats(value joy)
+/* Callback stubs which must be installed regardless of the OCaml callbacks
+   set on a window, because events are queued or input is tracked. */
+static unsigned int forced_callbacks(
+    const struct ml_window_data* ml_window_data)
 {
-    CAMLparam0();
-    CAMLlocal1(ret);
-    int count;
-    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+    unsigned int ret = 0;
 
-    raise_if_error();
-    if (count == 0)
-        ret = Atom(0);
-    else
-    {
-        ret = caml_alloc_small(count, 0);
-        for (int i = 0; i < count; ++i)
-            Field(ret, i) = Val_unit;
-        for (int i = 0; i < count; ++i)
-            Store_field(ret, i, caml_list_of_flags(hats[i], 4));
-    }
-    CAMLreturn(ret);
+    if (ml_window_data->queue_events)
+        ret |= ML_QUEUEABLE_CALLBACKS;
+    if (ml_window_data->track_input)
+        ret |= ML_CALLBACK_BIT(key) | ML_CALLBACK_BIT(mouse_button);
+    return ret;
 }
 
-CAMLprim value caml_glfwGetJoystickGUID(value joy)
+CAMLprim value caml_setEventQueueing(value ml_window, value enabled)
 {
-    const char* name = glfwGetJoystickGUID(Int_val(joy));
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_data* ml_window_data = glfwGetWindowUserPointer(window);
 
     raise_if_error();
-    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+    ml_window_data->queue_events = Bool_val(enabled);
+    ml_window_data->forced_callbacks = forced_callbacks(ml_window_data);
+    update_window_callback_stubs(window);
+    raise_if_error();
+    return Val_unit;
 }
 
-CAMLprim value caml_glfwGetJoystickName(value joy)
+CAMLprim value caml_getEventQueueing(value window)
 {
-    const char* name = glfwGetJoystickName(Int_val(joy));
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(Cptr_val(GLFWwindow*, window));
 
     raise_if_error();
-    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+    return Val_bool(ml_window_data->queue_events);
 }
 
-CAMLprim value caml_glfwJoystickIsGamepad(value joy)
+CAMLprim value caml_setInputTracking(value ml_window, value enabled)
 {
-    int ret = glfwJoystickIsGamepad(Int_val(joy));
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_data* ml_window_data = glfwGetWindowUserPointer(window);
+
     raise_if_error();
-    return Val_bool(ret);
+    if (!Bool_val(enabled))
+        memset(&ml_window_data->input_state, 0,
+               sizeof(ml_window_data->input_state));
+    ml_window_data->track_input = Bool_val(enabled);
+    ml_window_data->forced_callbacks = forced_callbacks(ml_window_data);
+    update_window_callback_stubs(window);
+    raise_if_error();
+    return Val_unit;
 }
 
-static value joystick_closure = Val_unit;
-
-void joystick_callback_stub(int joy, int event)
+CAMLprim value caml_getInputTracking(value window)
 {
-    caml_callback2(
-        joystick_closure, Val_int(joy), Val_int(event - GLFW_DISCONNECTED));
-}
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(Cptr_val(GLFWwindow*, window));
 
-CAML_SETTER_STUB(glfwSetJoystickCallback, joystick)
+    raise_if_error();
+    return Val_bool(ml_window_data->track_input);
+}
 
-CAMLprim value caml_glfwUpdateGamepadMappings(value string)
+/* Collecting statistics again starts from an empty history. */
+CAMLprim value caml_setFrameStatsCollection(value ml_window, value enabled)
 {
-    glfwUpdateGamepadMappings(String_val(string));
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(Cptr_val(GLFWwindow*, ml_window));
+
     raise_if_error();
+    free_frame_stats(ml_window_data);
+    if (Bool_val(enabled))
+    {
+        ml_window_data->frame_stats =
+            calloc(1, sizeof(*ml_window_data->frame_stats));
+        if (ml_window_data->frame_stats == NULL)
+            caml_raise_out_of_memory();
+        ++frame_stats_windows;
+    }
     return Val_unit;
 }
 
-CAMLprim value caml_glfwGetGamepadName(value joy)
+static value caml_copy_event(const struct ml_event* event)
 {
-    const char* name = glfwGetGamepadName(Int_val(joy));
+    CAMLparam0();
+    CAMLlocal3(ret, arg1, arg2);
+    const int* i = event->args.i;
 
-    raise_if_error();
-    return name == NULL ? Val_none : caml_alloc_some(caml_copy_string(name));
+    switch (event->type)
+    {
+    case WindowPosEvent:
+    case WindowSizeEvent:
+    case FramebufferSizeEvent:
+        ret = caml_alloc_small(3, event->type);
+        Field(ret, 0) = Val_cptr(event->window);
+        Field(ret, 1) = Val_int(i[0]);
+        Field(ret, 2) = Val_int(i[1]);
+        break;
+
+    case WindowCloseEvent:
+    case WindowRefreshEvent:
+        ret = caml_alloc_small(1, event->type);
+        Field(ret, 0) = Val_cptr(event->window);
+        break;
+
+    case WindowFocusEvent:
+    case WindowIconifyEvent:
+    case WindowMaximizeEvent:
+    case CursorEnterEvent:
+        ret = caml_alloc_small(2, event->type);
+        Field(ret, 0) = Val_cptr(event->window);
+        Field(ret, 1) = Val_bool(i[0]);
+        break;
+
+    case CharEvent:
+        ret = caml_alloc_small(2, event->type);
+        Field(ret, 0) = Val_cptr(event->window);
+        Field(ret, 1) = Val_int(i[0]);
+        break;
+
+    case WindowContentScaleEvent:
+    case CursorPosEvent:
+    case ScrollEvent:
+        arg1 = caml_copy_double(event->args.d[0]);
+        arg2 = caml_copy_double(event->args.d[1]);
+        ret = caml_alloc_small(3, event->type);
+        Field(ret, 0) = Val_cptr(event->window);
+        Field(ret, 1) = arg1;
+        Field(ret, 2) = arg2;
+        break;
+
+    case KeyEvent:
+        arg1 = caml_list_of_flags(i[3], 4);
+        ret = caml_alloc_small(5, event->type);
+        Field(ret, 0) = Val_cptr(event->window);
+        Field(ret, 1) = Val_int(glfw_to_ml_key[i[0] - GLFW_KEY_FIRST]);
+        Field(ret, 2) = Val_int(i[1]);
+        Field(ret, 3) = Val_int(i[2]);
+        Field(ret, 4) = arg1;
+        break;
+
+    case MouseButtonEvent:
+        arg1 = caml_list_of_flags(i[2], 4);
+        ret = caml_alloc_small(4, event->type);
+        Field(ret, 0) = Val_cptr(event->window);
+        Field(ret, 1) = Val_int(i[0]);
+        Field(ret, 2) = Val_bool(i[1]);
+        Field(ret, 3) = arg1;
+    }
+    CAMLreturn(ret);
 }
 
-CAMLprim value caml_glfwGetGamepadState(value joy)
+CAMLprim value caml_drainEvents(CAMLvoid)
 {
     CAMLparam0();
-    CAMLlocal3(buttons, axes, ret);
-    GLFWgamepadstate gamepad_state;
+    CAMLlocal2(ret, ml_event);
+    const size_t count = event_queue_length;
 
-    glfwGetGamepadState(Int_val(joy), &gamepad_state);
-    raise_if_error();
-    buttons = caml_alloc_small(15, 0);
-    for (unsigned int i = 0; i < 15; ++i)
-        Field(buttons, i) = Val_bool(gamepad_state.buttons[i] == GLFW_PRESS);
-    axes = caml_alloc_float_array(6);
-    for (unsigned int i = 0; i < 6; ++i)
-        Store_double_field(axes, i, gamepad_state.axes[i]);
-    ret = caml_alloc_small(2, 0);
-    Field(ret, 0) = buttons;
-    Field(ret, 1) = axes;
+    if (count == 0)
+        CAMLreturn(Atom(0));
+    ret = caml_alloc(count, 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        /* Copy the record since the queue may be reallocated if a
+           finaliser run by the allocations below happens to poll events. */
+        struct ml_event event = event_queue[i];
+
+        ml_event = caml_copy_event(&event);
+        Store_field(ret, i, ml_event);
+    }
+    event_queue_length -= count;
+    memmove(event_queue, event_queue + count,
+            event_queue_length * sizeof(*event_queue));
     CAMLreturn(ret);
 }
 
-CAMLprim value caml_glfwSetClipboardString(CAMLvoid, value string)
+CAMLprim value caml_pollEventsBatch(CAMLvoid)
 {
-    glfwSetClipboardString(NULL, String_val(string));
+    ML_PROFILE_TRACED();
+    const uint64_t start = begin_dispatch();
+
+    begin_event_processing();
+    glfwPollEvents();
     raise_if_error();
-    return Val_unit;
+    flush_coalesced_events();
+    if (start != 0)
+        poll_ticks += glfwGetTimerValue() - start;
+    return caml_drainEvents(Val_unit);
 }
 
-CAMLprim value caml_glfwGetClipboardString(CAMLvoid)
+CAMLprim value caml_glfwJoystickPresent(value joy)
 {
-    const char* string = glfwGetClipboardString(NULL);
+    ML_PROFILE();
+    int ret = glfwJoystickPresent(Int_val(joy));
     raise_if_error();
-    return caml_copy_string(string);
+    return Val_bool(ret);
 }
 
-CAMLprim value caml_glfwGetTime(CAMLvoid)
+static value caml_copy_joystick_axes(const float* axes, int count)
 {
-    double time = glfwGetTime();
-    raise_if_error();
-    return caml_copy_double(time);
+    value ret = caml_alloc_float_array(count);
+
+    for (int i = 0; i < count; ++i)
+        Store_double_field(ret, i, axes[i]);
+    return ret;
 }
 
-CAMLprim value caml_glfwSetTime(value time)
+CAMLprim value caml_glfwGetJoystickAxes(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const float* axes = glfwGetJoystickAxes(Int_val(joy), &count);
+
+    raise_if_error();
+    return caml_copy_joystick_axes(axes, count);
+}
+
+static value caml_copy_joystick_buttons(const unsigned char* buttons, int count)
+{
+    value ret;
+
+    if (count == 0)
+        return Atom(0);
+    ret = caml_alloc_small(count, 0);
+    for (int i = 0; i < count; ++i)
+        Field(ret, i) = Val_bool(buttons[i] == GLFW_PRESS);
+    return ret;
+}
+
+CAMLprim value caml_glfwGetJoystickButtons(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const unsigned char* buttons = glfwGetJoystickButtons(Int_val(joy), &count);
+
+    raise_if_error();
+    return caml_copy_joystick_buttons(buttons, count);
+}
+
+static value caml_copy_joystick_hats(const unsigned char* hats, int count)
+{
+    CAMLparam0();
+    CAMLlocal1(ret);
+
+    if (count == 0)
+        ret = Atom(0);
+    else
+    {
+        ret = caml_alloc_small(count, 0);
+        for (int i = 0; i < count; ++i)
+            Field(ret, i) = Val_unit;
+        for (int i = 0; i < count; ++i)
+            Store_field(ret, i, caml_list_of_flags(hats[i], 4));
+    }
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_glfwGetJoystickHats(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+
+    raise_if_error();
+    return caml_copy_joystick_hats(hats, count);
+}
+
+static value caml_copy_joystick_hats_bitset(
+    const unsigned char* hats, int count)
+{
+    value ret;
+
+    if (count == 0)
+        return Atom(0);
+    ret = caml_alloc_small(count, 0);
+    for (int i = 0; i < count; ++i)
+        Field(ret, i) = Val_int(hats[i]);
+    return ret;
+}
+
+CAMLprim value caml_glfwGetJoystickHatsBitset(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+
+    raise_if_error();
+    return caml_copy_joystick_hats_bitset(hats, count);
+}
+
+static value caml_copy_string_option(const char* string)
+{
+    return string == NULL
+        ? Val_none : caml_alloc_some(caml_copy_string(string));
+}
+
+CAMLprim value caml_glfwGetJoystickGUID(value joy)
+{
+    ML_PROFILE();
+    const char* name = glfwGetJoystickGUID(Int_val(joy));
+
+    raise_if_error();
+    return caml_copy_string_option(name);
+}
+
+CAMLprim value caml_glfwGetJoystickName(value joy)
+{
+    ML_PROFILE();
+    const char* name = glfwGetJoystickName(Int_val(joy));
+
+    raise_if_error();
+    return caml_copy_string_option(name);
+}
+
+CAMLprim value caml_glfwJoystickIsGamepad(value joy)
+{
+    ML_PROFILE();
+    int ret = glfwJoystickIsGamepad(Int_val(joy));
+    raise_if_error();
+    return Val_bool(ret);
+}
+
+static value joystick_closure = Val_unit;
+
+void joystick_callback_stub(int joy, int event)
+{
+    ML_PROFILE_CALLBACK();
+    acquire_runtime();
+
+    const double minor_words = begin_allocation_count();
+
+    caml_callback2(
+        joystick_closure, Val_int(joy), Val_int(event - GLFW_DISCONNECTED));
+    end_allocation_count(minor_words);
+}
+
+CAML_SETTER_STUB(glfwSetJoystickCallback, joystick)
+
+CAMLprim value caml_glfwUpdateGamepadMappings(value string)
 {
-    glfwSetTime(Double_val(time));
+    ML_PROFILE();
+    glfwUpdateGamepadMappings(String_val(string));
     raise_if_error();
     return Val_unit;
 }
 
-CAMLprim value caml_glfwGetTimerValue(CAMLvoid)
+CAMLprim value caml_glfwGetGamepadName(value joy)
+{
+    ML_PROFILE();
+    const char* name = glfwGetGamepadName(Int_val(joy));
+
+    raise_if_error();
+    return caml_copy_string_option(name);
+}
+
+static value caml_copy_gamepad_state(const GLFWgamepadstate* gamepad_state)
+{
+    CAMLparam0();
+    CAMLlocal3(buttons, axes, ret);
+
+    buttons = caml_alloc_small(15, 0);
+    for (unsigned int i = 0; i < 15; ++i)
+        Field(buttons, i) = Val_bool(gamepad_state->buttons[i] == GLFW_PRESS);
+    axes = caml_alloc_float_array(6);
+    for (unsigned int i = 0; i < 6; ++i)
+        Store_double_field(axes, i, gamepad_state->axes[i]);
+    ret = caml_alloc_small(2, 0);
+    Field(ret, 0) = buttons;
+    Field(ret, 1) = axes;
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_glfwGetGamepadState(value joy)
+{
+    ML_PROFILE();
+    GLFWgamepadstate gamepad_state;
+
+    glfwGetGamepadState(Int_val(joy), &gamepad_state);
+    raise_if_error();
+    return caml_copy_gamepad_state(&gamepad_state);
+}
+
+CAMLprim value caml_glfwSetClipboardString(CAMLvoid, value string)
+{
+    ML_PROFILE();
+    glfwSetClipboardString(NULL, String_val(string));
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwGetClipboardString(CAMLvoid)
+{
+    ML_PROFILE();
+    const char* string = glfwGetClipboardString(NULL);
+    raise_if_error();
+    return caml_copy_string(string);
+}
+
+/* The Bigarray variants copy the clipboard contents into a caller-supplied
+   buffer only if it is large enough, and always return their length. */
+static size_t copy_clipboard(const char* string, value buffer)
+{
+    const size_t length = string == NULL ? 0 : strlen(string);
+
+    if (length <= (size_t)Caml_ba_array_val(buffer)->dim[0])
+        memcpy(Caml_ba_data_val(buffer), string, length);
+    return length;
+}
+
+CAMLprim value caml_getClipboardBigarray(value buffer)
+{
+    const char* string = glfwGetClipboardString(NULL);
+    raise_if_error();
+    return Val_long(copy_clipboard(string, buffer));
+}
+
+/* Reusable heap buffer, grown to hold at least size bytes. Returns NULL
+   when out of memory, leaving the buffer as it was. */
+static char* reserve_buffer(char** buffer, size_t* capacity, size_t size)
+{
+    if (size > *capacity)
+    {
+        char* grown = realloc(*buffer, size);
+
+        if (grown == NULL)
+            return NULL;
+        *buffer = grown;
+        *capacity = size;
+    }
+    return *buffer;
+}
+
+/* Hash and copy of the contents last copied by
+   caml_getClipboardBigarrayIfChanged. Hash hits are confirmed by comparing
+   the contents. */
+static int clipboard_seen = 0;
+static uint64_t clipboard_hash;
+static size_t clipboard_length;
+static char* clipboard_copy = NULL;
+static size_t clipboard_copy_capacity = 0;
+
+CAMLprim value caml_getClipboardBigarrayIfChanged(value buffer)
+{
+    const char* string = glfwGetClipboardString(NULL);
+    size_t length;
+    uint64_t hash;
+
+    raise_if_error();
+    length = string == NULL ? 0 : strlen(string);
+    hash = fnv1a(ML_FNV1A_OFFSET_BASIS, string, length);
+    if (clipboard_seen && length == clipboard_length && hash == clipboard_hash
+        && (length == 0 || memcmp(clipboard_copy, string, length) == 0))
+        return Val_long(-1);
+    copy_clipboard(string, buffer);
+    if (length <= (size_t)Caml_ba_array_val(buffer)->dim[0])
+    {
+        /* Without a copy, the next call cannot tell the contents apart. */
+        clipboard_seen = reserve_buffer(&clipboard_copy,
+                                        &clipboard_copy_capacity,
+                                        length + 1) != NULL;
+        if (clipboard_seen && length > 0)
+            memcpy(clipboard_copy, string, length);
+        clipboard_hash = hash;
+        clipboard_length = length;
+    }
+    return Val_long(length);
+}
+
+/* GLFW needs a NUL-terminated string, which is built in a scratch buffer as
+   the Bigarray may be read-only or shared with other threads. */
+static char* clipboard_scratch = NULL;
+static size_t clipboard_scratch_capacity = 0;
+
+CAMLprim value caml_setClipboardBigarray(value data, value ml_length)
+{
+    const size_t length = Long_val(ml_length);
+    char* copy = reserve_buffer(
+        &clipboard_scratch, &clipboard_scratch_capacity, length + 1);
+
+    if (copy == NULL)
+        caml_raise_out_of_memory();
+    memcpy(copy, Caml_ba_data_val(data), length);
+    copy[length] = '\0';
+    glfwSetClipboardString(NULL, copy);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim double caml_glfwGetTime_unboxed(CAMLvoid)
+{
+    ML_PROFILE();
+    double time = glfwGetTime();
+    raise_if_error();
+    return time;
+}
+
+CAMLprim value caml_glfwGetTime(CAMLvoid)
+{
+    return caml_copy_double(caml_glfwGetTime_unboxed(Val_unit));
+}
+
+CAMLprim value caml_glfwSetTime_unboxed(double time)
+{
+    ML_PROFILE();
+    glfwSetTime(time);
+    raise_if_error();
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwSetTime(value time)
+{
+    return caml_glfwSetTime_unboxed(Double_val(time));
+}
+
+CAMLprim int64_t caml_glfwGetTimerValue_unboxed(CAMLvoid)
 {
+    ML_PROFILE();
     uint64_t timer_value = glfwGetTimerValue();
     raise_if_error();
-    return caml_copy_int64(timer_value);
+    return timer_value;
 }
 
-CAMLprim value caml_glfwGetTimerFrequency(CAMLvoid)
+CAMLprim value caml_glfwGetTimerValue(CAMLvoid)
+{
+    return caml_copy_int64(caml_glfwGetTimerValue_unboxed(Val_unit));
+}
+
+CAMLprim int64_t caml_glfwGetTimerFrequency_unboxed(CAMLvoid)
 {
+    ML_PROFILE();
     uint64_t timer_frequency = glfwGetTimerFrequency();
     raise_if_error();
-    return caml_copy_int64(timer_frequency);
+    return timer_frequency;
+}
+
+CAMLprim value caml_glfwGetTimerFrequency(CAMLvoid)
+{
+    return caml_copy_int64(caml_glfwGetTimerFrequency_unboxed(Val_unit));
+}
+
+/* Tables of GL function pointers resolved once per context, so that C stubs
+   can call them through a single indirection. Tables follow the context made
+   current with makeContextCurrent and are only reloaded when its signature
+   differs from the one they were loaded for. */
+struct ml_proc_table
+{
+    struct ml_proc_table* next;
+    int loaded;
+    int signature[ML_CONTEXT_SIGNATURE_SIZE];
+    unsigned int count;
+    char** names;
+    GLFWglproc procs[];
+};
+
+static struct ml_proc_table* proc_tables = NULL;
+
+static void load_proc_table(struct ml_proc_table* table, const int* signature)
+{
+    if (table->loaded
+        && memcmp(table->signature, signature, sizeof(table->signature)) == 0)
+        return;
+    for (unsigned int i = 0; i < table->count; ++i)
+        table->procs[i] = glfwGetProcAddress(table->names[i]);
+    memcpy(table->signature, signature, sizeof(table->signature));
+    table->loaded = 1;
+}
+
+static void reload_proc_tables(GLFWwindow* window)
+{
+    for (struct ml_proc_table* table = proc_tables; table != NULL;
+         table = table->next)
+        load_proc_table(table, Window_data(window)->context_signature);
+}
+
+static void unload_proc_tables(void)
+{
+    for (struct ml_proc_table* table = proc_tables; table != NULL;
+         table = table->next)
+    {
+        memset(table->procs, 0, table->count * sizeof(*table->procs));
+        table->loaded = 0;
+    }
 }
 
 CAMLprim value caml_glfwMakeContextCurrent(value window)
 {
-    glfwMakeContextCurrent(
-        Is_none(window) ? NULL : Cptr_val(GLFWwindow*, Some_val(window)));
+    ML_PROFILE();
+    GLFWwindow* glfw_window =
+        Is_none(window) ? NULL : Cptr_val(GLFWwindow*, Some_val(window));
+
+    glfwMakeContextCurrent(glfw_window);
     raise_if_error();
+    if (glfw_window != NULL)
+        reload_proc_tables(glfw_window);
     return Val_unit;
 }
 
 CAMLprim value caml_glfwGetCurrentContext(CAMLvoid)
 {
+    ML_PROFILE();
     GLFWwindow* window = glfwGetCurrentContext();
 
     raise_if_error();
@@ -1512,13 +4305,34 @@ CAMLprim value caml_glfwGetCurrentContext(CAMLvoid)
 
 CAMLprim value caml_glfwSwapBuffers(value window)
 {
-    glfwSwapBuffers(Cptr_val(GLFWwindow*, window));
+    ML_PROFILE_TRACED();
+    GLFWwindow* glfw_window = Cptr_val(GLFWwindow*, window);
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(glfw_window);
+
+    raise_if_error();
+    struct ml_capture* capture = ml_window_data->capture;
+    struct ml_frame_stats* stats = ml_window_data->frame_stats;
+    uint64_t swap_start = 0;
+
+    if (capture != NULL && glfwGetCurrentContext() != glfw_window)
+        capture = NULL;
+    release_runtime();
+    if (capture != NULL)
+        capture_frame(glfw_window, capture);
+    if (stats != NULL)
+        swap_start = glfwGetTimerValue();
+    glfwSwapBuffers(glfw_window);
+    if (stats != NULL)
+        record_frame(stats, swap_start, glfwGetTimerValue());
+    acquire_runtime();
     raise_if_error();
     return Val_unit;
 }
 
 CAMLprim value caml_glfwSwapInterval(value interval)
 {
+    ML_PROFILE();
     glfwSwapInterval(Int_val(interval));
     raise_if_error();
     return Val_unit;
@@ -1526,7 +4340,1497 @@ CAMLprim value caml_glfwSwapInterval(value interval)
 
 CAMLprim value caml_glfwExtensionSupported(value extension)
 {
+    ML_PROFILE();
     int result = glfwExtensionSupported(String_val(extension));
     raise_if_error();
     return Val_bool(result);
 }
+
+CAMLprim value caml_glfwGetProcAddress(value procname)
+{
+    ML_PROFILE();
+    GLFWglproc proc = glfwGetProcAddress(String_val(procname));
+
+    raise_if_error();
+    return proc == NULL
+        ? Val_none : caml_alloc_some(caml_copy_nativeint((intnat)proc));
+}
+
+static void free_proc_table(struct ml_proc_table* table)
+{
+    for (unsigned int i = 0; i < table->count; ++i)
+        free(table->names[i]);
+    free(table->names);
+    free(table);
+}
+
+/* Returns NULL when out of memory. */
+static struct ml_proc_table* create_proc_table(
+    const char* const* names, unsigned int count, GLFWwindow* current)
+{
+    struct ml_proc_table* table =
+        malloc(sizeof(*table) + count * sizeof(*table->procs));
+
+    if (table == NULL)
+        return NULL;
+    table->loaded = 0;
+    table->count = 0;
+    table->names = calloc(count, sizeof(*table->names));
+    if (table->names == NULL && count > 0)
+    {
+        free(table);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        table->names[i] = strdup(names[i]);
+        table->procs[i] = NULL;
+        table->count = i + 1;
+        if (table->names[i] == NULL)
+        {
+            free_proc_table(table);
+            return NULL;
+        }
+    }
+    if (current != NULL)
+        load_proc_table(table, Window_data(current)->context_signature);
+    table->next = proc_tables;
+    proc_tables = table;
+    return table;
+}
+
+CAMLprim value caml_createProcTable(value ml_names)
+{
+    const unsigned int count = Wosize_val(ml_names);
+    GLFWwindow* window = glfwGetCurrentContext();
+
+    raise_if_error();
+    const char** names = malloc(count * sizeof(*names));
+    if (names == NULL && count > 0)
+        caml_raise_out_of_memory();
+    for (unsigned int i = 0; i < count; ++i)
+        names[i] = String_val(Field(ml_names, i));
+    struct ml_proc_table* table = create_proc_table(names, count, window);
+    free(names);
+    if (table == NULL)
+        caml_raise_out_of_memory();
+    return Val_cptr(table);
+}
+
+CAMLprim value caml_destroyProcTable(value ml_table)
+{
+    struct ml_proc_table* table = Cptr_val(struct ml_proc_table*, ml_table);
+    struct ml_proc_table** p = &proc_tables;
+
+    while (*p != table)
+        p = &(*p)->next;
+    *p = table->next;
+    free_proc_table(table);
+    return Val_unit;
+}
+
+CAMLprim value caml_getProcTableEntry(value ml_table, value index)
+{
+    struct ml_proc_table* table = Cptr_val(struct ml_proc_table*, ml_table);
+
+    if ((uintnat)Long_val(index) >= table->count)
+        caml_invalid_argument("getProcTableEntry: index out of bounds.");
+    return caml_copy_nativeint((intnat)table->procs[Long_val(index)]);
+}
+
+CAMLprim value caml_getProcTableAddress(value table)
+{
+    return caml_copy_nativeint(
+        (intnat)Cptr_val(struct ml_proc_table*, table)->procs);
+}
+
+/* Some of the stubs below call GL functions themselves. These are resolved
+   through a proc table of our own and called with the platform's GL calling
+   convention. Each function is tagged with the feature needing it so that
+   a missing function only makes that feature unavailable. */
+#ifdef _WIN32
+# define ML_GLAPI __stdcall
+#else
+# define ML_GLAPI
+#endif
+
+#define ML_GL_COLOR_BUFFER_BIT 0x4000
+#define ML_GL_UNSIGNED_BYTE 0x1401
+#define ML_GL_RGBA 0x1908
+#define ML_GL_NEAREST 0x2600
+#define ML_GL_LINEAR 0x2601
+#define ML_GL_TEXTURE_MAG_FILTER 0x2800
+#define ML_GL_TEXTURE_MIN_FILTER 0x2801
+#define ML_GL_TEXTURE_2D 0x0DE1
+#define ML_GL_UNPACK_ROW_LENGTH 0x0CF2
+#define ML_GL_UNPACK_SKIP_ROWS 0x0CF3
+#define ML_GL_UNPACK_SKIP_PIXELS 0x0CF4
+#define ML_GL_READ_FRAMEBUFFER 0x8CA8
+#define ML_GL_DRAW_FRAMEBUFFER 0x8CA9
+#define ML_GL_COLOR_ATTACHMENT0 0x8CE0
+#define ML_GL_PIXEL_PACK_BUFFER 0x88EB
+#define ML_GL_STREAM_READ 0x88E1
+#define ML_GL_MAP_READ_BIT 0x0001
+
+enum ml_gl_feature
+{
+    GlFeaturePresentPixels,
+    GlFeatureCapture
+};
+
+#define ML_GL_PROCS(X)                                                  \
+    X(GlFeaturePresentPixels, GenTextures, void,                        \
+      (int n, unsigned int* textures))                                  \
+    X(GlFeaturePresentPixels, BindTexture, void,                        \
+      (unsigned int target, unsigned int texture))                      \
+    X(GlFeaturePresentPixels, TexParameteri, void,                      \
+      (unsigned int target, unsigned int pname, int param))             \
+    X(GlFeaturePresentPixels, TexImage2D, void,                         \
+      (unsigned int target, int level, int internalformat, int width,   \
+       int height, int border, unsigned int format, unsigned int type,  \
+       const void* pixels))                                             \
+    X(GlFeaturePresentPixels, TexSubImage2D, void,                      \
+      (unsigned int target, int level, int xoffset, int yoffset,        \
+       int width, int height, unsigned int format, unsigned int type,   \
+       const void* pixels))                                             \
+    X(GlFeaturePresentPixels, PixelStorei, void,                        \
+      (unsigned int pname, int param))                                  \
+    X(GlFeaturePresentPixels, GenFramebuffers, void,                    \
+      (int n, unsigned int* framebuffers))                              \
+    X(GlFeaturePresentPixels, BindFramebuffer, void,                    \
+      (unsigned int target, unsigned int framebuffer))                  \
+    X(GlFeaturePresentPixels, FramebufferTexture2D, void,               \
+      (unsigned int target, unsigned int attachment,                    \
+       unsigned int textarget, unsigned int texture, int level))        \
+    X(GlFeaturePresentPixels, BlitFramebuffer, void,                    \
+      (int src_x0, int src_y0, int src_x1, int src_y1, int dst_x0,      \
+       int dst_y0, int dst_x1, int dst_y1, unsigned int mask,           \
+       unsigned int filter))                                            \
+    X(GlFeatureCapture, GenBuffers, void, (int n, unsigned int* buffers)) \
+    X(GlFeatureCapture, DeleteBuffers, void,                            \
+      (int n, const unsigned int* buffers))                             \
+    X(GlFeatureCapture, BindBuffer, void,                               \
+      (unsigned int target, unsigned int buffer))                       \
+    X(GlFeatureCapture, BufferData, void,                               \
+      (unsigned int target, intptr_t size, const void* data,            \
+       unsigned int usage))                                             \
+    X(GlFeatureCapture, MapBufferRange, void*,                          \
+      (unsigned int target, intptr_t offset, intptr_t length,           \
+       unsigned int access))                                            \
+    X(GlFeatureCapture, UnmapBuffer, unsigned char, (unsigned int target)) \
+    X(GlFeatureCapture, ReadPixels, void,                               \
+      (int x, int y, int width, int height, unsigned int format,        \
+       unsigned int type, void* pixels))
+
+#define ML_GL_PROC_TYPEDEF(feature, name, ret, params) \
+    typedef ret (ML_GLAPI* ml_gl##name##_proc) params;
+ML_GL_PROCS(ML_GL_PROC_TYPEDEF)
+#undef ML_GL_PROC_TYPEDEF
+
+#define ML_GL_PROC_INDEX(feature, name, ret, params) Gl##name,
+enum ml_gl_proc
+{
+    ML_GL_PROCS(ML_GL_PROC_INDEX)
+    GlProcCount
+};
+#undef ML_GL_PROC_INDEX
+
+#define ML_GL_PROC_NAME(feature, name, ret, params) "gl" #name,
+static const char* const gl_proc_names[] = {ML_GL_PROCS(ML_GL_PROC_NAME)};
+#undef ML_GL_PROC_NAME
+
+#define ML_GL_PROC_FEATURE(feature, name, ret, params) feature,
+static const enum ml_gl_feature gl_proc_features[] = {
+    ML_GL_PROCS(ML_GL_PROC_FEATURE)
+};
+#undef ML_GL_PROC_FEATURE
+
+static struct ml_proc_table* gl_procs = NULL;
+
+#define ML_GL(name) ((ml_gl##name##_proc)gl_procs->procs[Gl##name])
+
+/* Makes the context of the window current if it was not already, then
+   checks the functions needed by the feature could be resolved for it. */
+static void require_gl_feature(
+    GLFWwindow* window, enum ml_gl_feature feature, const char* function)
+{
+    if (glfwGetCurrentContext() != window)
+    {
+        glfwMakeContextCurrent(window);
+        raise_if_error();
+        reload_proc_tables(window);
+    }
+    if (gl_procs == NULL)
+        gl_procs = create_proc_table(gl_proc_names, GlProcCount, window);
+    if (gl_procs == NULL)
+        caml_raise_out_of_memory();
+    for (unsigned int i = 0; i < GlProcCount; ++i)
+        if (gl_proc_features[i] == feature && gl_procs->procs[i] == NULL)
+        {
+            error_code = GLFW_API_UNAVAILABLE;
+            snprintf(error_description, sizeof(error_description),
+                     "%s: %s is not supported by the context.", function,
+                     gl_proc_names[i]);
+            raise_if_error();
+        }
+}
+
+/* presentPixels uploads the image into a texture attached to a framebuffer
+   object which is then blitted onto the back buffer, so that it works with
+   any context supporting framebuffer objects including software ones. */
+static void upload_pixels(
+    const GLFWimage* image, int x, int y, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return;
+    ML_GL(PixelStorei)(ML_GL_UNPACK_ROW_LENGTH, image->width);
+    ML_GL(PixelStorei)(ML_GL_UNPACK_SKIP_PIXELS, x);
+    ML_GL(PixelStorei)(ML_GL_UNPACK_SKIP_ROWS, y);
+    ML_GL(TexSubImage2D)(ML_GL_TEXTURE_2D, 0, x, y, width, height,
+                         ML_GL_RGBA, ML_GL_UNSIGNED_BYTE, image->pixels);
+}
+
+/* Uploads the damaged parts of the image, or all of it when rects is NULL
+   or the texture had to be resized, then draws it over the whole back
+   buffer. Image rows are stored top to bottom, so the blit flips them. */
+static void present_pixels(
+    GLFWwindow* window, struct ml_presenter* presenter,
+    const GLFWimage* image, const int (*rects)[4], unsigned int rect_count)
+{
+    int fb_width, fb_height;
+
+    if (presenter->texture == 0)
+    {
+        ML_GL(GenTextures)(1, &presenter->texture);
+        ML_GL(GenFramebuffers)(1, &presenter->framebuffer);
+    }
+    ML_GL(BindTexture)(ML_GL_TEXTURE_2D, presenter->texture);
+    if (presenter->width != image->width || presenter->height != image->height)
+    {
+        ML_GL(TexParameteri)(
+            ML_GL_TEXTURE_2D, ML_GL_TEXTURE_MIN_FILTER, ML_GL_LINEAR);
+        ML_GL(TexParameteri)(
+            ML_GL_TEXTURE_2D, ML_GL_TEXTURE_MAG_FILTER, ML_GL_LINEAR);
+        ML_GL(TexImage2D)(ML_GL_TEXTURE_2D, 0, ML_GL_RGBA, image->width,
+                          image->height, 0, ML_GL_RGBA, ML_GL_UNSIGNED_BYTE,
+                          NULL);
+        ML_GL(BindFramebuffer)(ML_GL_READ_FRAMEBUFFER, presenter->framebuffer);
+        ML_GL(FramebufferTexture2D)(
+            ML_GL_READ_FRAMEBUFFER, ML_GL_COLOR_ATTACHMENT0, ML_GL_TEXTURE_2D,
+            presenter->texture, 0);
+        presenter->width = image->width;
+        presenter->height = image->height;
+        rects = NULL;
+    }
+    if (rects == NULL)
+        upload_pixels(image, 0, 0, image->width, image->height);
+    else
+        for (unsigned int i = 0; i < rect_count; ++i)
+            upload_pixels(image, rects[i][0], rects[i][1], rects[i][2],
+                          rects[i][3]);
+    ML_GL(PixelStorei)(ML_GL_UNPACK_ROW_LENGTH, 0);
+    ML_GL(PixelStorei)(ML_GL_UNPACK_SKIP_PIXELS, 0);
+    ML_GL(PixelStorei)(ML_GL_UNPACK_SKIP_ROWS, 0);
+    ML_GL(BindTexture)(ML_GL_TEXTURE_2D, 0);
+
+    glfwGetFramebufferSize(window, &fb_width, &fb_height);
+    ML_GL(BindFramebuffer)(ML_GL_READ_FRAMEBUFFER, presenter->framebuffer);
+    ML_GL(BindFramebuffer)(ML_GL_DRAW_FRAMEBUFFER, 0);
+    ML_GL(BlitFramebuffer)(
+        0, 0, image->width, image->height, 0, fb_height, fb_width, 0,
+        ML_GL_COLOR_BUFFER_BIT,
+        fb_width == image->width && fb_height == image->height
+        ? ML_GL_NEAREST : ML_GL_LINEAR);
+    ML_GL(BindFramebuffer)(ML_GL_READ_FRAMEBUFFER, 0);
+    glfwSwapBuffers(window);
+}
+
+/* OCaml integers have one bit less than intnat, so sums of two of them cannot
+   overflow before being clamped. */
+static inline int clamp_to_image(intnat coordinate, int size)
+{
+    if (coordinate < 0)
+        return 0;
+    return coordinate > size ? size : (int)coordinate;
+}
+
+CAMLprim value caml_presentPixels(
+    value ml_window, value ml_image, value ml_damage)
+{
+    CAMLparam3(ml_window, ml_image, ml_damage);
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    GLFWimage image;
+    int (*rects)[4] = NULL;
+    unsigned int rect_count = 0;
+
+    require_gl_feature(window, GlFeaturePresentPixels, "presentPixels");
+    image_of_ml_image(&image, ml_image, 1);
+    if (image.width == 0 || image.height == 0)
+        CAMLreturn(Val_unit);
+    if (Is_some(ml_damage))
+    {
+        value damage = Some_val(ml_damage);
+
+        rect_count = Wosize_val(damage);
+        rects = malloc((rect_count + 1) * sizeof(*rects));
+        if (rects == NULL)
+            caml_raise_out_of_memory();
+        for (unsigned int i = 0; i < rect_count; ++i)
+        {
+            value rect = Field(damage, i);
+            const intnat x = Long_val(Field(rect, 0));
+            const intnat y = Long_val(Field(rect, 1));
+            const int x0 = clamp_to_image(x, image.width);
+            const int y0 = clamp_to_image(y, image.height);
+            const int x1 = clamp_to_image(
+                x + Long_val(Field(rect, 2)), image.width);
+            const int y1 = clamp_to_image(
+                y + Long_val(Field(rect, 3)), image.height);
+
+            rects[i][0] = x0;
+            rects[i][1] = y0;
+            rects[i][2] = x1 - x0;
+            rects[i][3] = y1 - y0;
+        }
+    }
+    release_runtime();
+    present_pixels(window, &Window_data(window)->presenter, &image,
+                   (const int (*)[4])rects, rect_count);
+    acquire_runtime();
+    free(rects);
+    raise_if_error();
+    CAMLreturn(Val_unit);
+}
+
+/* Frame capture. Each swapBuffers on a capturing window starts reading its
+   back buffer into the next pixel pack buffer of a ring and, once the ring
+   is full, maps the oldest one. Frames are thus available count - 1 swaps
+   after being rendered without the read stalling the pipeline. Mapped
+   frames may also be copied to a writer thread streaming them to a file,
+   where POSIX threads are available. */
+#define ML_CAPTURE_MAX_BUFFERS 16
+#define ML_CAPTURE_MAX_QUEUED 8
+
+/* Output file formats, in the same order as the constructors of the
+   capture_output type. */
+enum ml_capture_format
+{
+    CaptureRaw,
+    CaptureY4M
+};
+
+struct ml_capture_frame
+{
+    struct ml_capture_frame* next;
+    int width;
+    int height;
+    unsigned char pixels[];
+};
+
+#ifdef ML_PTHREADS
+struct ml_capture_writer
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct ml_capture_frame* first;
+    struct ml_capture_frame** last;
+    unsigned int queued;
+    int stopping;
+    FILE* file;
+    enum ml_capture_format format;
+    int fps;
+    int width;
+    int height;
+    unsigned char* planes;
+};
+#endif
+
+struct ml_capture_slot
+{
+    unsigned int buffer;
+    int width;
+    int height;
+};
+
+struct ml_capture
+{
+    unsigned int count;
+    unsigned int head;
+    unsigned int pending;
+    int mapped;
+    void* mapped_pixels;
+    unsigned long dropped;
+    struct ml_capture_writer* writer;
+    struct ml_capture_slot slots[];
+};
+
+/* Windows being captured. */
+static struct ml_window_data* capturing_windows = NULL;
+
+/* Removes the capture of a window, if any, from the window and the list of
+   windows being captured, and returns it. */
+static struct ml_capture* detach_capture(struct ml_window_data* ml_window_data)
+{
+    struct ml_capture* capture = ml_window_data->capture;
+    struct ml_window_data** iter = &capturing_windows;
+
+    if (capture == NULL)
+        return NULL;
+    while (*iter != ml_window_data)
+        iter = &(*iter)->next_capturing;
+    *iter = ml_window_data->next_capturing;
+    ml_window_data->capture = NULL;
+    return capture;
+}
+
+#ifdef ML_PTHREADS
+/* Converts a frame to BT.601 Y'CbCr 4:4:4 planes. Rows are read bottom to
+   top as they come from glReadPixels. The planes are allocated with the
+   first frame, which is dropped if that fails, as are the following ones
+   until it succeeds. */
+static void write_y4m_frame(
+    struct ml_capture_writer* writer, const struct ml_capture_frame* frame)
+{
+    const size_t plane_size = (size_t)frame->width * frame->height;
+    unsigned char *y_plane, *cb_plane, *cr_plane;
+
+    if (writer->planes == NULL)
+        writer->planes = malloc(3 * plane_size);
+    if (writer->planes == NULL)
+        return;
+    y_plane = writer->planes;
+    cb_plane = y_plane + plane_size;
+    cr_plane = cb_plane + plane_size;
+    for (int y = 0; y < frame->height; ++y)
+    {
+        const unsigned char* row = frame->pixels
+            + 4 * (size_t)frame->width * (frame->height - 1 - y);
+
+        for (int x = 0; x < frame->width; ++x)
+        {
+            const int r = row[4 * x], g = row[4 * x + 1], b = row[4 * x + 2];
+            const size_t i = (size_t)y * frame->width + x;
+
+            y_plane[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            cb_plane[i] = (-38 * r - 74 * g + 112 * b + 128 + 32768) >> 8;
+            cr_plane[i] = (112 * r - 94 * g - 18 * b + 128 + 32768) >> 8;
+        }
+    }
+    fputs("FRAME\n", writer->file);
+    fwrite(writer->planes, 1, 3 * plane_size, writer->file);
+}
+
+/* The stream takes the size of its first frame. Frames of another size,
+   as happens when the window is resized, are skipped. */
+static void write_capture_frame(
+    struct ml_capture_writer* writer, const struct ml_capture_frame* frame)
+{
+    if (writer->width == 0)
+    {
+        writer->width = frame->width;
+        writer->height = frame->height;
+        if (writer->format == CaptureY4M)
+            fprintf(writer->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+                    frame->width, frame->height, writer->fps);
+    }
+    if (frame->width != writer->width || frame->height != writer->height)
+        return;
+    if (writer->format == CaptureY4M)
+        write_y4m_frame(writer, frame);
+    else
+        for (int y = frame->height; y-- > 0; )
+            fwrite(frame->pixels + 4 * (size_t)frame->width * y, 4,
+                   frame->width, writer->file);
+}
+
+static void* capture_writer_main(void* data)
+{
+    struct ml_capture_writer* writer = data;
+
+    for (;;)
+    {
+        struct ml_capture_frame* frame;
+
+        pthread_mutex_lock(&writer->mutex);
+        while (writer->first == NULL && !writer->stopping)
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        frame = writer->first;
+        if (frame != NULL)
+        {
+            writer->first = frame->next;
+            if (writer->first == NULL)
+                writer->last = &writer->first;
+        }
+        pthread_mutex_unlock(&writer->mutex);
+        if (frame == NULL)
+            break;
+        write_capture_frame(writer, frame);
+        free(frame);
+        pthread_mutex_lock(&writer->mutex);
+        --writer->queued;
+        pthread_mutex_unlock(&writer->mutex);
+    }
+    return NULL;
+}
+
+/* Returns zero when the writer lags too far behind or the frame cannot be
+   copied, in which case it has to be dropped. */
+static int queue_capture_frame(
+    struct ml_capture_writer* writer, const void* pixels, int width,
+    int height)
+{
+    const size_t size = 4 * (size_t)width * height;
+    struct ml_capture_frame* frame;
+    int accepted;
+
+    pthread_mutex_lock(&writer->mutex);
+    accepted = writer->queued < ML_CAPTURE_MAX_QUEUED;
+    if (accepted)
+        ++writer->queued;
+    pthread_mutex_unlock(&writer->mutex);
+    if (!accepted)
+        return 0;
+    frame = malloc(sizeof(*frame) + size);
+    if (frame == NULL)
+    {
+        pthread_mutex_lock(&writer->mutex);
+        --writer->queued;
+        pthread_mutex_unlock(&writer->mutex);
+        return 0;
+    }
+    frame->next = NULL;
+    frame->width = width;
+    frame->height = height;
+    memcpy(frame->pixels, pixels, size);
+    pthread_mutex_lock(&writer->mutex);
+    *writer->last = frame;
+    writer->last = &frame->next;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    return 1;
+}
+
+/* Returns NULL with errno set on failure. */
+static struct ml_capture_writer* start_capture_writer(
+    FILE* file, enum ml_capture_format format, int fps)
+{
+    struct ml_capture_writer* writer = malloc(sizeof(*writer));
+    int error;
+
+    if (writer == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(writer, 0, sizeof(*writer));
+    writer->last = &writer->first;
+    writer->file = file;
+    writer->format = format;
+    writer->fps = fps;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    error = pthread_create(&writer->thread, NULL, capture_writer_main, writer);
+    if (error != 0)
+    {
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->mutex);
+        free(writer);
+        errno = error;
+        return NULL;
+    }
+    return writer;
+}
+
+/* Waits for the writer to write every queued frame before closing the
+   file. */
+static void stop_capture_writer(struct ml_capture_writer* writer)
+{
+    pthread_mutex_lock(&writer->mutex);
+    writer->stopping = 1;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+    fclose(writer->file);
+    free(writer->planes);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer);
+}
+#endif
+
+static void unmap_captured_frame(struct ml_capture* capture)
+{
+    if (capture->mapped < 0)
+        return;
+    ML_GL(BindBuffer)(
+        ML_GL_PIXEL_PACK_BUFFER, capture->slots[capture->mapped].buffer);
+    ML_GL(UnmapBuffer)(ML_GL_PIXEL_PACK_BUFFER);
+    ML_GL(BindBuffer)(ML_GL_PIXEL_PACK_BUFFER, 0);
+    capture->mapped = -1;
+    capture->mapped_pixels = NULL;
+}
+
+static void map_captured_frame(struct ml_capture* capture)
+{
+    const unsigned int index =
+        (capture->head + capture->count - capture->pending) % capture->count;
+    struct ml_capture_slot* slot = &capture->slots[index];
+
+    ML_GL(BindBuffer)(ML_GL_PIXEL_PACK_BUFFER, slot->buffer);
+    capture->mapped_pixels = ML_GL(MapBufferRange)(
+        ML_GL_PIXEL_PACK_BUFFER, 0, 4 * (intptr_t)slot->width * slot->height,
+        ML_GL_MAP_READ_BIT);
+    ML_GL(BindBuffer)(ML_GL_PIXEL_PACK_BUFFER, 0);
+    --capture->pending;
+    if (capture->mapped_pixels == NULL)
+        return;
+    capture->mapped = index;
+#ifdef ML_PTHREADS
+    if (capture->writer != NULL
+        && !queue_capture_frame(capture->writer, capture->mapped_pixels,
+                                slot->width, slot->height))
+        ++capture->dropped;
+#endif
+}
+
+static void capture_frame(GLFWwindow* window, struct ml_capture* capture)
+{
+    struct ml_capture_slot* slot = &capture->slots[capture->head];
+    int width, height;
+
+    unmap_captured_frame(capture);
+    glfwGetFramebufferSize(window, &width, &height);
+    if (width == 0 || height == 0)
+        return;
+    ML_GL(BindBuffer)(ML_GL_PIXEL_PACK_BUFFER, slot->buffer);
+    if (slot->width != width || slot->height != height)
+    {
+        ML_GL(BufferData)(ML_GL_PIXEL_PACK_BUFFER, 4 * (intptr_t)width * height,
+                          NULL, ML_GL_STREAM_READ);
+        slot->width = width;
+        slot->height = height;
+    }
+    ML_GL(ReadPixels)(
+        0, 0, width, height, ML_GL_RGBA, ML_GL_UNSIGNED_BYTE, NULL);
+    ML_GL(BindBuffer)(ML_GL_PIXEL_PACK_BUFFER, 0);
+    capture->head = (capture->head + 1) % capture->count;
+    if (++capture->pending == capture->count)
+        map_captured_frame(capture);
+}
+
+/* Also used when destroying a window, where the buffers go away with its
+   context. */
+static void free_capture(struct ml_capture* capture)
+{
+#ifdef ML_PTHREADS
+    if (capture->writer != NULL)
+        stop_capture_writer(capture->writer);
+#endif
+    free(capture);
+}
+
+CAMLprim value caml_startCapture(value ml_window, value ml_count, value output)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_data* ml_window_data = Window_data(window);
+    const long count = Long_val(ml_count);
+    struct ml_capture* capture;
+    struct ml_capture_writer* writer = NULL;
+
+    if (count < 1 || count > ML_CAPTURE_MAX_BUFFERS)
+        caml_invalid_argument("startCapture: buffer count out of range.");
+    if (ml_window_data->capture != NULL)
+        caml_invalid_argument("startCapture: capture already started.");
+    require_gl_feature(window, GlFeatureCapture, "startCapture");
+    if (Is_some(output))
+    {
+#ifdef ML_PTHREADS
+        const value ml_output = Some_val(output);
+        const char* path = String_val(Field(ml_output, 0));
+        FILE* file = fopen(path, "wb");
+
+        if (file == NULL)
+        {
+            char message[1024];
+
+            snprintf(message, sizeof(message), "%s: %s", path,
+                     strerror(errno));
+            caml_raise_sys_error(caml_copy_string(message));
+        }
+        writer = start_capture_writer(
+            file, Tag_val(ml_output),
+            Tag_val(ml_output) == CaptureY4M
+            ? Int_val(Field(ml_output, 1)) : 0);
+        if (writer == NULL)
+        {
+            const int error = errno;
+
+            fclose(file);
+            if (error == ENOMEM)
+                caml_raise_out_of_memory();
+            caml_failwith("startCapture: cannot start the writer thread.");
+        }
+#else
+        error_code = GLFW_API_UNAVAILABLE;
+        snprintf(error_description, sizeof(error_description),
+                 "startCapture: file output requires POSIX threads.");
+        raise_if_error();
+#endif
+    }
+    capture = malloc(sizeof(*capture) + count * sizeof(*capture->slots));
+    if (capture == NULL)
+    {
+#ifdef ML_PTHREADS
+        if (writer != NULL)
+            stop_capture_writer(writer);
+#endif
+        caml_raise_out_of_memory();
+    }
+    capture->count = count;
+    capture->head = 0;
+    capture->pending = 0;
+    capture->mapped = -1;
+    capture->mapped_pixels = NULL;
+    capture->dropped = 0;
+    capture->writer = writer;
+    for (unsigned int i = 0; i < capture->count; ++i)
+    {
+        ML_GL(GenBuffers)(1, &capture->slots[i].buffer);
+        capture->slots[i].width = 0;
+        capture->slots[i].height = 0;
+    }
+    ml_window_data->capture = capture;
+    ml_window_data->next_capturing = capturing_windows;
+    capturing_windows = ml_window_data;
+    return Val_unit;
+}
+
+/* Frames still in flight are mapped and passed to the writer, which then
+   finishes writing them. Must be called with the context of the window
+   current. */
+static void finish_capture(struct ml_capture* capture)
+{
+    unmap_captured_frame(capture);
+    while (capture->pending > 0)
+    {
+        map_captured_frame(capture);
+        unmap_captured_frame(capture);
+    }
+    for (unsigned int i = 0; i < capture->count; ++i)
+        ML_GL(DeleteBuffers)(1, &capture->slots[i].buffer);
+    free_capture(capture);
+}
+
+CAMLprim value caml_stopCapture(value ml_window)
+{
+    GLFWwindow* window = Cptr_val(GLFWwindow*, ml_window);
+    struct ml_window_data* ml_window_data = Window_data(window);
+    struct ml_capture* capture;
+
+    if (ml_window_data->capture == NULL)
+        return Val_unit;
+    require_gl_feature(window, GlFeatureCapture, "stopCapture");
+    capture = detach_capture(ml_window_data);
+    release_runtime();
+    finish_capture(capture);
+    acquire_runtime();
+    return Val_unit;
+}
+
+/* Terminating the library destroys every window, so their captures are
+   finished first, which stops the writer threads and closes the output
+   files. The frames still in flight are lost if the context of a window
+   cannot be made current. */
+static void stop_captures(void)
+{
+    while (capturing_windows != NULL)
+    {
+        struct ml_window_data* ml_window_data = capturing_windows;
+        GLFWwindow* window = ml_window_data->window;
+        struct ml_capture* capture = detach_capture(ml_window_data);
+
+        if (glfwGetCurrentContext() != window)
+        {
+            glfwMakeContextCurrent(window);
+            clear_error();
+            if (glfwGetCurrentContext() == window)
+                reload_proc_tables(window);
+        }
+        if (glfwGetCurrentContext() == window)
+            finish_capture(capture);
+        else
+            free_capture(capture);
+    }
+}
+
+/* The Bigarray aliases the mapped buffer, which is unmapped by the next
+   swapBuffers or stopCapture on the window. */
+CAMLprim value caml_getCapturedFrame(value window)
+{
+    struct ml_capture* capture =
+        Window_data(Cptr_val(GLFWwindow*, window))->capture;
+    struct ml_capture_slot* slot;
+
+    if (capture == NULL || capture->mapped < 0)
+        return Val_none;
+    slot = &capture->slots[capture->mapped];
+    return caml_alloc_some(caml_ba_alloc_dims(
+        CAML_BA_UINT8 | CAML_BA_C_LAYOUT | CAML_BA_EXTERNAL, 3,
+        capture->mapped_pixels, (intnat)slot->height, (intnat)slot->width,
+        (intnat)4));
+}
+
+CAMLprim value caml_getCaptureDroppedFrames(value window)
+{
+    struct ml_capture* capture =
+        Window_data(Cptr_val(GLFWwindow*, window))->capture;
+
+    return Val_long(capture == NULL ? 0 : capture->dropped);
+}
+
+/* GLFW only declares the functions using Vulkan types when the Vulkan header
+   has been included first. Declare the few types these need here instead so
+   that building does not require the Vulkan SDK: dispatchable handles are
+   pointers to opaque structures and non-dispatchable handles such as
+   VkSurfaceKHR are 64-bit wide on every platform. */
+#ifndef VK_VERSION_1_0
+typedef struct VkInstance_T* VkInstance;
+typedef struct VkPhysicalDevice_T* VkPhysicalDevice;
+typedef uint64_t VkSurfaceKHR;
+typedef struct VkAllocationCallbacks VkAllocationCallbacks;
+typedef int VkResult;
+
+GLFWAPI GLFWvkproc glfwGetInstanceProcAddress(
+    VkInstance instance, const char* procname);
+GLFWAPI int glfwGetPhysicalDevicePresentationSupport(
+    VkInstance instance, VkPhysicalDevice device, uint32_t queuefamily);
+GLFWAPI VkResult glfwCreateWindowSurface(
+    VkInstance instance, GLFWwindow* window,
+    const VkAllocationCallbacks* allocator, VkSurfaceKHR* surface);
+#endif
+
+CAMLprim value caml_glfwVulkanSupported(CAMLvoid)
+{
+    ML_PROFILE();
+    int result = glfwVulkanSupported();
+    raise_if_error();
+    return Val_bool(result);
+}
+
+CAMLprim value caml_glfwGetRequiredInstanceExtensions(CAMLvoid)
+{
+    ML_PROFILE();
+    CAMLparam0();
+    CAMLlocal2(ret, str);
+    uint32_t count = 0;
+    const char** extensions = glfwGetRequiredInstanceExtensions(&count);
+
+    raise_if_error();
+    if (extensions == NULL)
+        CAMLreturn(Atom(0));
+    ret = caml_alloc(count, 0);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        str = caml_copy_string(extensions[i]);
+        Store_field(ret, i, str);
+    }
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_glfwGetInstanceProcAddress(value instance, value procname)
+{
+    ML_PROFILE();
+    GLFWvkproc proc = glfwGetInstanceProcAddress(
+        Is_none(instance) ? NULL : Cptr_val(VkInstance, Some_val(instance)),
+        String_val(procname));
+
+    raise_if_error();
+    return proc == NULL
+        ? Val_none : caml_alloc_some(caml_copy_nativeint((intnat)proc));
+}
+
+CAMLprim value caml_glfwGetPhysicalDevicePresentationSupport(
+    value instance, value device, value queuefamily)
+{
+    ML_PROFILE();
+    int result = glfwGetPhysicalDevicePresentationSupport(
+        Cptr_val(VkInstance, instance), Cptr_val(VkPhysicalDevice, device),
+        Long_val(queuefamily));
+    raise_if_error();
+    return Val_bool(result);
+}
+
+CAMLprim value caml_glfwCreateWindowSurface(value instance, value window)
+{
+    ML_PROFILE();
+    VkSurfaceKHR surface = 0;
+    VkResult result = glfwCreateWindowSurface(
+        Cptr_val(VkInstance, instance), Cptr_val(GLFWwindow*, window), NULL,
+        &surface);
+
+    /* GLFW reports its own failures but passes some Vulkan errors along
+       silently. */
+    if (result != 0 && error_code == GLFW_NO_ERROR)
+    {
+        error_code = GLFW_PLATFORM_ERROR;
+        snprintf(error_description, sizeof(error_description),
+                 "Vulkan: Failed to create window surface: VkResult %d.",
+                 (int)result);
+    }
+    raise_if_error();
+    return caml_copy_int64((int64_t)surface);
+}
+
+/* Vulkan objects are usually created through another binding, which exposes
+   dispatchable handles as raw pointers. */
+CAMLprim value caml_vkInstanceOfNativeint(value instance)
+{
+    return Val_cptr((void*)Nativeint_val(instance));
+}
+
+CAMLprim value caml_nativeintOfVkInstance(value instance)
+{
+    return caml_copy_nativeint((intnat)Cptr_val(VkInstance, instance));
+}
+
+CAMLprim value caml_vkPhysicalDeviceOfNativeint(value device)
+{
+    return Val_cptr((void*)Nativeint_val(device));
+}
+
+CAMLprim value caml_nativeintOfVkPhysicalDevice(value device)
+{
+    return caml_copy_nativeint((intnat)Cptr_val(VkPhysicalDevice, device));
+}
+
+/* The following stubs are declared noalloc, so they must neither allocate
+   nor raise. GLFW errors are discarded and the default values GLFW returns
+   in that case are passed along. */
+
+CAMLprim double caml_glfwGetTime_noalloc(CAMLvoid)
+{
+    ML_PROFILE();
+    double time = glfwGetTime();
+    clear_error();
+    return time;
+}
+
+CAMLprim value caml_glfwGetTime_noalloc_byte(CAMLvoid)
+{
+    return caml_copy_double(caml_glfwGetTime_noalloc(Val_unit));
+}
+
+CAMLprim intnat caml_getTimerNanoseconds_noalloc(CAMLvoid)
+{
+    uint64_t timer_value = glfwGetTimerValue();
+    uint64_t timer_frequency = glfwGetTimerFrequency();
+
+    clear_error();
+    if (timer_frequency == 0)
+        return 0;
+    return timer_value / timer_frequency * 1000000000
+        + timer_value % timer_frequency * 1000000000 / timer_frequency;
+}
+
+CAMLprim value caml_getTimerNanoseconds_noalloc_byte(CAMLvoid)
+{
+    return Val_long(caml_getTimerNanoseconds_noalloc(Val_unit));
+}
+
+CAMLprim value caml_glfwWindowShouldClose_noalloc(value window)
+{
+    ML_PROFILE();
+    int ret = glfwWindowShouldClose(Cptr_val(GLFWwindow*, window));
+    clear_error();
+    return Val_bool(ret);
+}
+
+CAMLprim value caml_glfwGetKey_noalloc(value window, value key)
+{
+    ML_PROFILE();
+    int ret =
+        glfwGetKey(Cptr_val(GLFWwindow*, window), ml_to_glfw_key[Int_val(key)]);
+    clear_error();
+    return Val_bool(ret);
+}
+
+CAMLprim value caml_glfwGetMouseButton_noalloc(value window, value button)
+{
+    ML_PROFILE();
+    int ret =
+        glfwGetMouseButton(Cptr_val(GLFWwindow*, window), Int_val(button));
+    clear_error();
+    return Val_bool(ret == GLFW_PRESS);
+}
+
+CAMLprim value caml_glfwGetCursorPosInto_noalloc(value window, value pos)
+{
+    ML_PROFILE();
+    double* data = Caml_ba_data_val(pos);
+
+    glfwGetCursorPos(Cptr_val(GLFWwindow*, window), data, data + 1);
+    clear_error();
+    return Val_unit;
+}
+
+/* Storing integers in an OCaml array does not require caml_modify. */
+
+CAMLprim value caml_glfwGetWindowSizeInto_noalloc(value window, value size)
+{
+    ML_PROFILE();
+    int width, height;
+
+    glfwGetWindowSize(Cptr_val(GLFWwindow*, window), &width, &height);
+    clear_error();
+    Field(size, 0) = Val_int(width);
+    Field(size, 1) = Val_int(height);
+    return Val_unit;
+}
+
+CAMLprim value caml_glfwGetFramebufferSizeInto_noalloc(value window, value size)
+{
+    ML_PROFILE();
+    int width, height;
+
+    glfwGetFramebufferSize(Cptr_val(GLFWwindow*, window), &width, &height);
+    clear_error();
+    Field(size, 0) = Val_int(width);
+    Field(size, 1) = Val_int(height);
+    return Val_unit;
+}
+
+CAMLprim value caml_getInputSnapshot_noalloc(value window, value state)
+{
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(Cptr_val(GLFWwindow*, window));
+
+    clear_error();
+    if (ml_window_data == NULL)
+        memset(Bytes_val(state), 0, sizeof(struct ml_input_state));
+    else
+    {
+        sync_input_edges(ml_window_data);
+        memcpy(Bytes_val(state), &ml_window_data->input_state,
+               sizeof(struct ml_input_state));
+    }
+    return Val_unit;
+}
+
+static int compare_ticks(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Stores the 50th, 95th and 99th percentiles of each frame metric in turn,
+   in seconds, using the nearest-rank method. */
+CAMLprim value caml_getFrameStatsInto_noalloc(value window, value ml_stats)
+{
+    static const unsigned int percentiles[] = { 50, 95, 99 };
+    struct ml_window_data* ml_window_data =
+        glfwGetWindowUserPointer(Cptr_val(GLFWwindow*, window));
+    const uint64_t frequency = glfwGetTimerFrequency();
+    double* data = Caml_ba_data_val(ml_stats);
+    uint64_t sorted[ML_FRAME_STATS_SIZE];
+
+    clear_error();
+    for (unsigned int m = 0; m < FrameMetricCount; ++m)
+    {
+        const struct ml_frame_stats* stats =
+            ml_window_data == NULL ? NULL : ml_window_data->frame_stats;
+        const unsigned int count = stats == NULL ? 0 : stats->count;
+
+        if (count > 0)
+        {
+            memcpy(sorted, stats->samples[m], count * sizeof(*sorted));
+            qsort(sorted, count, sizeof(*sorted), compare_ticks);
+        }
+        for (unsigned int p = 0; p < 3; ++p)
+            *data++ = count == 0 || frequency == 0 ? 0.0
+                : (double)sorted[(percentiles[p] * count + 99) / 100 - 1]
+                / frequency;
+    }
+    return Val_unit;
+}
+
+CAMLprim value caml_setProfiling(value enabled)
+{
+#ifdef ML_PROFILING
+    if (Bool_val(enabled))
+        __atomic_or_fetch(&instrumentation, InstrumentProfile,
+                          __ATOMIC_SEQ_CST);
+    else
+        __atomic_and_fetch(&instrumentation, ~InstrumentProfile,
+                           __ATOMIC_SEQ_CST);
+#endif
+    return Val_unit;
+}
+
+CAMLprim value caml_isProfiling(CAMLvoid)
+{
+    return Val_bool(instrumentation & InstrumentProfile);
+}
+
+CAMLprim value caml_resetProfile(CAMLvoid)
+{
+    for (struct ml_profile_entry* entry = profile_entries; entry != NULL;
+         entry = entry->next)
+    {
+        entry->calls = 0;
+        entry->total_ns = 0;
+        entry->minor_words = 0.0;
+        memset(entry->histogram, 0, sizeof(entry->histogram));
+    }
+    return Val_unit;
+}
+
+/* Each row holds the number of calls, the cumulative time in seconds, the
+   minor words allocated by the OCaml callbacks and the latency histogram of
+   a stub called since the last reset. */
+#define ML_PROFILE_COLUMNS (3 + ML_PROFILE_BUCKETS)
+
+CAMLprim value caml_getProfile(CAMLvoid)
+{
+    CAMLparam0();
+    CAMLlocal3(names, table, ret);
+    struct ml_profile_entry* entry;
+    unsigned int count = 0, i = 0;
+    double* row;
+
+    for (entry = profile_entries; entry != NULL; entry = entry->next)
+        count += entry->calls > 0;
+    names = caml_alloc(count, 0);
+    table = caml_ba_alloc_dims(
+        CAML_BA_FLOAT64 | CAML_BA_C_LAYOUT, 2, NULL, (intnat)count,
+        (intnat)ML_PROFILE_COLUMNS);
+    row = Caml_ba_data_val(table);
+    for (entry = profile_entries; entry != NULL && i < count;
+         entry = entry->next)
+    {
+        if (entry->calls == 0)
+            continue;
+        Store_field(names, i, caml_copy_string(entry->name));
+        row[0] = entry->calls;
+        row[1] = entry->total_ns / 1e9;
+        row[2] = entry->minor_words;
+        for (unsigned int b = 0; b < ML_PROFILE_BUCKETS; ++b)
+            row[3 + b] = entry->histogram[b];
+        row += ML_PROFILE_COLUMNS;
+        ++i;
+    }
+    ret = caml_alloc_small(2, 0);
+    Field(ret, 0) = names;
+    Field(ret, 1) = table;
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_startTrace(value ml_capacity)
+{
+    const intnat capacity = Long_val(ml_capacity);
+
+    if (capacity < 1)
+        caml_invalid_argument("startTrace: capacity must be positive.");
+    if (instrumentation & InstrumentTrace)
+        caml_invalid_argument("startTrace: tracing already started.");
+#ifdef ML_PROFILING
+    wait_for_trace_writers();
+    if ((uint64_t)capacity != trace_capacity)
+    {
+        free(trace_spans);
+        trace_capacity = 0;
+        trace_spans = malloc(capacity * sizeof(*trace_spans));
+        if (trace_spans == NULL)
+            caml_raise_out_of_memory();
+        trace_capacity = capacity;
+    }
+    memset(trace_spans, 0, trace_capacity * sizeof(*trace_spans));
+    trace_next = 0;
+    trace_origin = profile_clock();
+    __atomic_or_fetch(&instrumentation, InstrumentTrace, __ATOMIC_SEQ_CST);
+#else
+    error_code = GLFW_API_UNAVAILABLE;
+    snprintf(error_description, sizeof(error_description),
+             "startTrace: instrumentation was compiled out.");
+    raise_if_error();
+#endif
+    return Val_unit;
+}
+
+CAMLprim value caml_stopTrace(CAMLvoid)
+{
+#ifdef ML_PROFILING
+    __atomic_and_fetch(&instrumentation, ~InstrumentTrace, __ATOMIC_SEQ_CST);
+#endif
+    return Val_unit;
+}
+
+/* Writes the spans kept in the ring in the Chrome trace event format, as
+   complete events with timestamps in microseconds since startTrace. The
+   number of spans overwritten because the ring was full or dropped because
+   their slot was being written is reported in the metadata. */
+CAMLprim value caml_writeTrace(value ml_path)
+{
+    CAMLparam1(ml_path);
+    uint64_t count, dropped, written = 0;
+    FILE* file;
+
+    if (instrumentation & InstrumentTrace)
+        caml_invalid_argument("writeTrace: tracing must be stopped first.");
+#ifdef ML_PROFILING
+    wait_for_trace_writers();
+#endif
+    count = trace_next < trace_capacity ? trace_next : trace_capacity;
+    dropped = trace_next - count;
+    file = fopen(String_val(ml_path), "w");
+    if (file == NULL)
+    {
+        char message[1024];
+
+        snprintf(message, sizeof(message), "%s: %s", String_val(ml_path),
+                 strerror(errno));
+        caml_raise_sys_error(caml_copy_string(message));
+    }
+    fputs("{\"traceEvents\":[", file);
+    for (uint64_t i = trace_next - count; i < trace_next; ++i)
+    {
+        const struct ml_trace_span* span = &trace_spans[i % trace_capacity];
+        const int64_t start = (int64_t)(span->start - trace_origin);
+
+        if (span->sequence != 2 * i + 2)
+        {
+            ++dropped;
+            continue;
+        }
+        fprintf(file,
+                "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f}",
+                written++ == 0 ? "" : ",", span->name, span->thread,
+                start / 1e3, span->duration / 1e3);
+    }
+    fprintf(file,
+            "\n],\"displayTimeUnit\":\"ms\","
+            "\"otherData\":{\"droppedSpans\":\"%llu\"}}\n",
+            (unsigned long long)dropped);
+    if (fclose(file) != 0)
+    {
+        char message[1024];
+
+        snprintf(message, sizeof(message), "%s: %s", String_val(ml_path),
+                 strerror(errno));
+        caml_raise_sys_error(caml_copy_string(message));
+    }
+    CAMLreturn(Val_unit);
+}
+
+/* The following stubs return an ('a, error) result instead of raising, the
+   error constructors being in the same order as the GLFW error codes. Only
+   the error code is returned, the description can be fetched afterwards
+   with caml_getErrorDescription. */
+
+static value caml_alloc_ok(value v)
+{
+    CAMLparam1(v);
+    value ok = caml_alloc_small(1, 0);
+    Field(ok, 0) = v;
+    CAMLreturn(ok);
+}
+
+static value caml_alloc_error(void)
+{
+    value error = caml_alloc_small(1, 1);
+    Field(error, 0) = Val_int(error_offset());
+    clear_error();
+    return error;
+}
+
+/* The value expression is only evaluated if no error occurred. */
+#define Result_val(v) \
+    (error_code == GLFW_NO_ERROR ? caml_alloc_ok(v) : caml_alloc_error())
+
+static value caml_alloc_int_pair(int fst, int snd)
+{
+    value ret = caml_alloc_small(2, 0);
+    Field(ret, 0) = Val_int(fst);
+    Field(ret, 1) = Val_int(snd);
+    return ret;
+}
+
+static value caml_copy_double_pair(double fst, double snd)
+{
+    CAMLparam0();
+    CAMLlocal3(ml_fst, ml_snd, ret);
+
+    ml_fst = caml_copy_double(fst);
+    ml_snd = caml_copy_double(snd);
+    ret = caml_alloc_small(2, 0);
+    Field(ret, 0) = ml_fst;
+    Field(ret, 1) = ml_snd;
+    CAMLreturn(ret);
+}
+
+CAMLprim value caml_getErrorDescription(CAMLvoid)
+{
+    return caml_copy_string(error_description);
+}
+
+CAMLprim value caml_glfwJoystickPresent_unchecked(value joy)
+{
+    ML_PROFILE();
+    int ret = glfwJoystickPresent(Int_val(joy));
+    return Result_val(Val_bool(ret));
+}
+
+CAMLprim value caml_glfwGetJoystickAxes_unchecked(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const float* axes = glfwGetJoystickAxes(Int_val(joy), &count);
+
+    return Result_val(caml_copy_joystick_axes(axes, count));
+}
+
+CAMLprim value caml_glfwGetJoystickButtons_unchecked(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const unsigned char* buttons = glfwGetJoystickButtons(Int_val(joy), &count);
+
+    return Result_val(caml_copy_joystick_buttons(buttons, count));
+}
+
+CAMLprim value caml_glfwGetJoystickHats_unchecked(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+
+    return Result_val(caml_copy_joystick_hats(hats, count));
+}
+
+CAMLprim value caml_glfwGetJoystickHatsBitset_unchecked(value joy)
+{
+    ML_PROFILE();
+    int count;
+    const unsigned char* hats = glfwGetJoystickHats(Int_val(joy), &count);
+
+    return Result_val(caml_copy_joystick_hats_bitset(hats, count));
+}
+
+CAMLprim value caml_glfwGetJoystickName_unchecked(value joy)
+{
+    ML_PROFILE();
+    const char* name = glfwGetJoystickName(Int_val(joy));
+    return Result_val(caml_copy_string_option(name));
+}
+
+CAMLprim value caml_glfwGetJoystickGUID_unchecked(value joy)
+{
+    ML_PROFILE();
+    const char* name = glfwGetJoystickGUID(Int_val(joy));
+    return Result_val(caml_copy_string_option(name));
+}
+
+CAMLprim value caml_glfwJoystickIsGamepad_unchecked(value joy)
+{
+    ML_PROFILE();
+    int ret = glfwJoystickIsGamepad(Int_val(joy));
+    return Result_val(Val_bool(ret));
+}
+
+CAMLprim value caml_glfwGetGamepadName_unchecked(value joy)
+{
+    ML_PROFILE();
+    const char* name = glfwGetGamepadName(Int_val(joy));
+    return Result_val(caml_copy_string_option(name));
+}
+
+CAMLprim value caml_glfwGetGamepadState_unchecked(value joy)
+{
+    ML_PROFILE();
+    GLFWgamepadstate gamepad_state;
+
+    glfwGetGamepadState(Int_val(joy), &gamepad_state);
+    return Result_val(caml_copy_gamepad_state(&gamepad_state));
+}
+
+CAMLprim value caml_glfwGetKey_unchecked(value window, value key)
+{
+    ML_PROFILE();
+    int ret =
+        glfwGetKey(Cptr_val(GLFWwindow*, window), ml_to_glfw_key[Int_val(key)]);
+    return Result_val(Val_bool(ret));
+}
+
+CAMLprim value caml_glfwGetMouseButton_unchecked(value window, value button)
+{
+    ML_PROFILE();
+    int ret =
+        glfwGetMouseButton(Cptr_val(GLFWwindow*, window), Int_val(button));
+    return Result_val(Val_bool(ret));
+}
+
+CAMLprim value caml_glfwGetCursorPos_unchecked(value window)
+{
+    ML_PROFILE();
+    double xpos, ypos;
+
+    glfwGetCursorPos(Cptr_val(GLFWwindow*, window), &xpos, &ypos);
+    return Result_val(caml_copy_double_pair(xpos, ypos));
+}
+
+CAMLprim value caml_glfwGetWindowPos_unchecked(value window)
+{
+    ML_PROFILE();
+    int xpos, ypos;
+
+    glfwGetWindowPos(Cptr_val(GLFWwindow*, window), &xpos, &ypos);
+    return Result_val(caml_alloc_int_pair(xpos, ypos));
+}
+
+CAMLprim value caml_glfwGetWindowSize_unchecked(value window)
+{
+    ML_PROFILE();
+    int width, height;
+
+    glfwGetWindowSize(Cptr_val(GLFWwindow*, window), &width, &height);
+    return Result_val(caml_alloc_int_pair(width, height));
+}
+
+CAMLprim value caml_glfwGetFramebufferSize_unchecked(value window)
+{
+    ML_PROFILE();
+    int width, height;
+
+    glfwGetFramebufferSize(Cptr_val(GLFWwindow*, window), &width, &height);
+    return Result_val(caml_alloc_int_pair(width, height));
+}
+
+CAMLprim value caml_glfwGetWindowFrameSize_unchecked(value window)
+{
+    ML_PROFILE();
+    CAMLparam0();
+    CAMLlocal1(ret);
+    int left, top, right, bottom;
+
+    glfwGetWindowFrameSize(
+        Cptr_val(GLFWwindow*, window), &left, &top, &right, &bottom);
+    if (error_code != GLFW_NO_ERROR)
+        CAMLreturn(caml_alloc_error());
+    ret = caml_alloc_small(4, 0);
+    Field(ret, 0) = Val_int(left);
+    Field(ret, 1) = Val_int(top);
+    Field(ret, 2) = Val_int(right);
+    Field(ret, 3) = Val_int(bottom);
+    CAMLreturn(caml_alloc_ok(ret));
+}
+
+CAMLprim value caml_glfwGetWindowContentScale_unchecked(value window)
+{
+    ML_PROFILE();
+    float xscale, yscale;
+
+    glfwGetWindowContentScale(Cptr_val(GLFWwindow*, window), &xscale, &yscale);
+    return Result_val(caml_copy_double_pair(xscale, yscale));
+}